@@ -3,44 +3,156 @@
  * \brief Interface to the USB library
  */
 
+#include <string.h>
 #include "usb.h"
+#include "mem.h"
+#include "trace.h"
+#include "profile.h"
+#include "sched.h"
+#include "clock.h"
 
-BYTE USB_send_buf[64];
+BYTE __attribute__ ((aligned(4))) USB_send_buf[USB_REPLY_HEADER_SIZE + USB_REPLY_MAX];
 struct USB_command_packet USB_command;
+BYTE __attribute__ ((aligned(4))) USB_upload_buffer[USB_UPLOAD_SIZE];
+
+static int USB_vendor_buf[16];
+
+static int USB_test_running;
+static unsigned int USB_test_word;
+static unsigned int USB_test_blocks;
+static unsigned int USB_test_stalls;
+static unsigned int USB_test_start;
+static unsigned int USB_test_length;
+
+static int USB_upload_running;
+// the upload is in but its reply hasn't gone out yet
+static int USB_upload_acking;
+static int USB_upload_valid;
+static unsigned int USB_upload_recv;
+static unsigned int USB_upload_arm;
+static unsigned int USB_upload_end;
+
+static BYTE* USB_beginReply(void);
+static void USB_endReply(int length);
+static void USB_fillTestBlock(unsigned int* block);
 
 void USB_init() {
     /**
      * Initialize the USB stack
      */
     USBDEVInitialize(0);
+
+    #ifdef USB_DEV_EVENT_SIGNALED
+    // USB interrupt at priority 4, to wake the USB task
+    IFS1CLR = USB_INT_BIT;
+    IPC11CLR = 0x00001C00;
+    IPC11SET = 0x00001000;
+    IEC1SET = USB_INT_BIT;
+    #endif
 }
 
 int USB_getNextCommand(void) {
     /**
      * Get the next command from the PC
+     *
+     * The PC may have several tagged commands in flight. They are left 
+     * waiting on the OUT endpoint until the reply to the previous command
+     * has been sent so that no reply is dropped while the IN endpoint is 
+     * busy.
+     *
+     * Commands arrive on the OUT endpoint ring, which keeps both ping-pong
+     * buffers armed: the packet is copied out and its buffer re-armed 
+     * straight away, so the next command can be received while this one
+     * executes.
+     */
+    BYTE* packet;
+    unsigned int length;
+
+    if(mUSBGenTxIsBusy()) {
+        return 0;
+    }
+    packet = USBGenGetPacket(&length);
+    if(packet == NULL) {
+        return 0;
+    }
+    if(length == 8) {
+        memcpy(&USB_command, packet, 8);
+    }
+    USBGenReleasePacket(NULL);
+    return(length == 8);
+}
+
+static BYTE* USB_beginReply(void) {
+    /**
+     * Get the buffer to build a reply payload in
+     *
+     * The payload starts after the reply header when the current command
+     * is tagged and at the start of the send buffer when it is not.
+     */
+    if(USB_command.tag != 0) {
+        return USB_send_buf + USB_REPLY_HEADER_SIZE;
+    }
+    return USB_send_buf;
+}
+
+static void USB_endReply(int length) {
+    /**
+     * Send a reply built with USB_beginReply
+     *
+     * Fills in the reply header for tagged commands so the PC can match
+     * the reply to the command it sent.
      */
-    return(USBGenRead((byte*)&USB_command,8) == 8);
+    struct USB_reply_header* header;
+
+    if(USB_command.tag != 0) {
+        header = (struct USB_reply_header*)USB_send_buf;
+        header->tag = USB_command.tag;
+        header->command = USB_command.command;
+        header->length = length;
+        length += USB_REPLY_HEADER_SIZE;
+    }
+    USBGenWrite(USB_send_buf,length);
 }
 
 void USB_sendAck() {
     /** 
      * Send 1 byte acknowledgement packet to the PC
      */
+    BYTE* reply;
+
     if(!mUSBGenTxIsBusy()) {
-        USB_send_buf[0] = 0x01;
-        USBGenWrite(USB_send_buf,1);
+        reply = USB_beginReply();
+        reply[0] = 0x01;
+        USB_endReply(1);
     }
     return;
 }
 
 
+void USB_sendNak() {
+    /** 
+     * Send 1 byte negative acknowledgement packet to the PC
+     */
+    BYTE* reply;
+
+    if(!mUSBGenTxIsBusy()) {
+        reply = USB_beginReply();
+        reply[0] = 0x00;
+        USB_endReply(1);
+    }
+    return;
+}
+
 void USB_sendVersion() {
     /** 
      * Send version number to the PC
      */
+    BYTE* reply;
+
     if(!mUSBGenTxIsBusy()) {
-        *(int*)&USB_send_buf[0] = VERSION;
-        USBGenWrite(USB_send_buf,4);
+        reply = USB_beginReply();
+        *(int*)&reply[0] = VERSION;
+        USB_endReply(4);
     }
     return;
 }
@@ -52,13 +164,103 @@ void USB_sendRaw(byte* address, int length) {
     USBGenWrite(address, length);
 }
 
+void USB_fillStatus(struct USB_status_packet* status) {
+    /**
+     * Fill in a status packet
+     *
+     * The MDAC value stays first so older PC software that reads it as
+     * the whole reply still finds it.
+     */
+    status->mdac_value = MDAC_value;
+    status->mode = SMP_MODE;
+    status->ring_fill = SMP_getFillLevel();
+    status->blocks_produced = SMP_PACKET_ID;
+    status->blocks_sent = SMP_BLOCKS_SENT;
+    status->overruns = SMP_OVERRUNS;
+    status->adc_isr_max_duration = TLM_adc_isr_max;
+    status->adc_isr_avg_duration = TLM_adc_isr_avg16 >> 4;
+    status->loop_rate = TLM_loop_rate;
+    status->usb_errors = USBGenGetErrors();
+    status->last_transmission = SMP_getLastTransmission();
+    status->loop_max = TLM_loop_max;
+    status->busy_load = TLM_busy_load;
+    status->isr_load = TLM_isr_load;
+    status->over_budget = TLM_over_budget;
+    status->init_time = TLM_init_us;
+    status->setup_time = TLM_setup_us;
+    status->mdac_drops = MDAC_drops;
+}
+
 void USB_sendStatus() {
     /**
      * Send a status packet over USB
      */
     if(!mUSBGenTxIsBusy()) {
-        *(int*)&USB_send_buf[0] = MDAC_value;
-        USB_sendRaw(USB_send_buf,4);
+        USB_fillStatus((struct USB_status_packet*)USB_beginReply());
+        USB_endReply(sizeof(struct USB_status_packet));
+    }
+}
+
+void USB_sendFrameTime() {
+    /**
+     * Send the USB frame to core timer mapping
+     *
+     * The PC polls this periodically. Since it knows when each frame 
+     * started on its side of the bus, it can use the frame number and 
+     * the core timer count to convert device timestamps to host time.
+     */
+    struct USB_frame_time_packet* reply;
+    unsigned long long now;
+
+    if(!mUSBGenTxIsBusy()) {
+        reply = (struct USB_frame_time_packet*)USB_beginReply();
+        USBHALGetFrameTime(&reply->frame, &reply->frame_time, &reply->frame_count);
+        reply->unused_short1 = 0;
+        now = CLK_now();
+        reply->now = (unsigned int)now;
+        reply->now_high = (unsigned int)(now >> 32);
+        reply->timer_rate = CLK_TICKS_PER_SEC;
+        USB_endReply(sizeof(struct USB_frame_time_packet));
+    }
+}
+
+int USB_sendIsrStats(int isr) {
+    /**
+     * Send the timing histograms of one ISR
+     *
+     * Returns 0 if the IN endpoint was busy and nothing was sent.
+     */
+    if(mUSBGenTxIsBusy()) {
+        return 0;
+    }
+    memcpy(USB_beginReply(), &TLM_isr[isr], sizeof(struct USB_isr_stats_packet));
+    USB_endReply(sizeof(struct USB_isr_stats_packet));
+    return 1;
+}
+
+void USB_fillMemory(struct USB_memory_packet* memory) {
+    /**
+     * Fill in a memory report
+     */
+    memory->ram_size = MEM_getRamSize();
+    memory->static_size = MEM_getStaticSize();
+    memory->heap_size = MEM_getHeapSize();
+    memory->stack_size = MEM_getStackSize();
+    memory->stack_used = MEM_getStackUsed();
+    memory->sample_buffers = sizeof(SMP_BUFFER) + sizeof(SMP_BUFFER_STATE);
+    memory->upload_buffer = sizeof(USB_upload_buffer);
+    memory->usb = USBHALGetRamUse() + USBGenGetRamUse() + sizeof(USB_send_buf) + sizeof(USB_vendor_buf) + sizeof(USB_command);
+    memory->diagnostics = sizeof(TRC_ring) + sizeof(PROF_data) + sizeof(TLM_isr);
+    memory->other = memory->static_size - memory->sample_buffers - memory->upload_buffer - memory->usb - memory->diagnostics;
+}
+
+void USB_sendMemory(void) {
+    /**
+     * Send a memory report over USB
+     */
+    if(!mUSBGenTxIsBusy()) {
+        USB_fillMemory((struct USB_memory_packet*)USB_beginReply());
+        USB_endReply(sizeof(struct USB_memory_packet));
     }
 }
 
@@ -73,21 +275,249 @@ void USB_sendPingReply() {
      */
      
     int i;
+    BYTE* reply;
      
     if(!mUSBGenTxIsBusy()) {
         if ( USB_command.ping_size > 64 ) {
             USB_command.ping_size = 64;
         }		
+        reply = USB_beginReply();
         for(i = 0; i<USB_command.ping_size; i++) {			
-            USB_send_buf[i] = 0x55;
+            reply[i] = 0x55;
         }
-        USB_sendRaw(USB_send_buf,USB_command.ping_size);
+        USB_endReply(USB_command.ping_size);
     }
 }
 
-void USB_handleEvents() {
+void USB_startBulkTest(void) {
+    /**
+     * Start the bulk throughput test
+     *
+     * Streams 1024 byte blocks for USB_command.length milliseconds as 
+     * fast as the IN endpoint takes them, then ends the stream with a 
+     * struct USB_bulk_test_packet (a short packet). The blocks carry a 
+     * running 32 bit counter, so word i of block n is n*256 + i and the
+     * PC can check every block it gets.
+     *
+     * The test borrows the first two sample buffers, so sampling is 
+     * stopped first. Commands are not read while the test runs.
+     */
+    if(SMP_MODE == SAMPLING) {
+        SMP_end();
+    }
+    USB_test_word = 0;
+    USB_test_blocks = 0;
+    USB_test_stalls = 0;
+    USB_test_length = USB_command.length * (GetSystemClock()/2000);
+    USB_fillTestBlock((unsigned int*)SMP_BUFFER);
+    USB_test_start = ReadCoreTimer();
+    USB_test_running = 1;
+}
+
+int USB_bulkTestRunning(void) {
+    /**
+     * Check if the bulk throughput test is running
+     */
+    return USB_test_running;
+}
+
+int USB_serviceBulkTest(void) {
+    /**
+     * Keep the bulk throughput test going
+     *
+     * Called from the main loop. Sends the next block whenever the IN 
+     * endpoint is free and fills the other block while it goes out.
+     *
+     * Returns 0 if the endpoint was still busy, so nothing was done.
+     */
+    struct USB_bulk_test_packet* reply;
+    unsigned int elapsed;
+
+    if(mUSBGenTxIsBusy()) {
+        USB_test_stalls++;
+        return 0;
+    }
+    elapsed = ReadCoreTimer() - USB_test_start;
+    if(elapsed < USB_test_length) {
+        USBGenWrite(SMP_BUFFER + (USB_test_blocks & 1)*SMP_BUFFER_SIZE, SMP_BUFFER_SIZE);
+        USB_test_blocks++;
+        USB_fillTestBlock((unsigned int*)(SMP_BUFFER + (USB_test_blocks & 1)*SMP_BUFFER_SIZE));
+        return 1;
+    }
+    reply = (struct USB_bulk_test_packet*)USB_beginReply();
+    reply->blocks = USB_test_blocks;
+    reply->stalls = USB_test_stalls;
+    reply->time = elapsed;
+    reply->timer_rate = GetSystemClock()/2;
+    USB_endReply(sizeof(struct USB_bulk_test_packet));
+    USB_test_running = 0;
+    return 1;
+}
+
+static void USB_fillTestBlock(unsigned int* block) {
+    /**
+     * Fill a block with the next 256 words of the test counter
+     */
+    int i;
+
+    for(i = 0; i < SMP_BUFFER_SIZE/4; i++) {
+        block[i] = USB_test_word++;
+    }
+}
+
+void USB_startUpload(void) {
+    /**
+     * Start receiving an upload
+     *
+     * The payload comes through the OUT endpoint ring in USB_UPLOAD_CHUNK
+     * sized packets. The two packets already armed with the driver's own
+     * buffers are copied into place; every buffer released after that is 
+     * re-armed inside the upload buffer, so the rest of the payload is 
+     * written there directly by the USB DMA.
+     *
+     * A request that does not fit is still read, but dropped. The reply
+     * is sent by USB_serviceUpload once the payload is in.
+     */
+    USB_upload_recv = USB_command.chunk * USB_UPLOAD_CHUNK;
+    USB_upload_end = USB_upload_recv + USB_command.length;
+    USB_upload_valid = (USB_upload_end <= USB_UPLOAD_SIZE);
+    USB_upload_arm = USB_upload_recv + 2*USB_UPLOAD_CHUNK;
+    USB_upload_running = (USB_command.length != 0);
+    USB_upload_acking = !USB_upload_running;
+}
+
+int USB_uploadRunning(void) {
+    /**
+     * Check if an upload is being received or waiting to reply
+     */
+    return USB_upload_running || USB_upload_acking;
+}
+
+int USB_serviceUpload(void) {
+    /**
+     * Take the next upload packet off the OUT endpoint ring
+     *
+     * Called from the main loop while an upload is running. Only whole 
+     * chunks are armed in the upload buffer so a packet can never land
+     * past the end of the upload; a short final chunk is copied. Once 
+     * the payload is in, the reply waits for the IN endpoint, and no 
+     * more commands are read until it has gone.
+     *
+     * Returns 0 if no packet had arrived or the reply is still waiting.
+     */
+    BYTE* packet;
+    BYTE* reply;
+    unsigned int length;
+    unsigned int count;
+
+    if(USB_upload_acking) {
+        if(mUSBGenTxIsBusy()) {
+            return 0;
+        }
+        reply = USB_beginReply();
+        reply[0] = USB_upload_valid ? 0x01 : 0x00;
+        USB_endReply(1);
+        USB_upload_acking = 0;
+        return 1;
+    }
+
+    packet = USBGenGetPacket(&length);
+    if(packet == NULL) {
+        return 0;
+    }
+
+    count = USB_upload_end - USB_upload_recv;
+    if(count > length) {
+        count = length;
+    }
+    if(USB_upload_valid && packet != USB_upload_buffer + USB_upload_recv) {
+        memcpy(USB_upload_buffer + USB_upload_recv, packet, count);
+    }
+    USB_upload_recv += count;
+
+    if(USB_upload_valid && USB_upload_arm + USB_UPLOAD_CHUNK <= USB_upload_end) {
+        USBGenReleasePacket(USB_upload_buffer + USB_upload_arm);
+    } else {
+        USBGenReleasePacket(NULL);
+    }
+    USB_upload_arm += USB_UPLOAD_CHUNK;
+
+    if(USB_upload_recv >= USB_upload_end || length < USB_UPLOAD_CHUNK) {
+        USB_upload_running = 0;
+        USB_upload_acking = 1;
+    }
+    return 1;
+}
+
+BOOL USB_handleVendorRequest(PSETUP_PKT pkt, void **data, unsigned int *length) {
+    /**
+     * Handle a vendor control request on endpoint 0
+     *
+     * Called by the device layer when a vendor request arrives. These 
+     * requests are handled right away instead of queueing on the bulk 
+     * OUT endpoint behind data transfers, so the MDAC can be changed or 
+     * the status read in the middle of a capture.
+     *
+     * Returns FALSE for unknown requests so the device layer stalls them.
+     */
+    struct USB_counters_packet* counters;
+
+    switch(pkt->bRequest) {
+        case VREQ_set_mdac:
+            MDAC_setValue(pkt->wValue);
+            *length = 0;
+            return TRUE;
+        case VREQ_status:
+            USB_fillStatus((struct USB_status_packet*)USB_vendor_buf);
+            *data = USB_vendor_buf;
+            *length = sizeof(struct USB_status_packet);
+            return TRUE;
+        case VREQ_counters:
+            counters = (struct USB_counters_packet*)USB_vendor_buf;
+            counters->mode = SMP_MODE;
+            counters->packet_id = SMP_PACKET_ID;
+            counters->sample_buffer = SMP_SAMPLE_BUFFER_NUM;
+            counters->send_buffer = SMP_SEND_BUFFER_NUM;
+            counters->last_transmission = SMP_getLastTransmission();
+            *data = counters;
+            *length = sizeof(struct USB_counters_packet);
+            return TRUE;
+        default:
+            return FALSE;
+    }
+}
+
+int USB_handleEvents() {
     /**
      * Handle processing for the USB module
+     *
+     * Turns the USB interrupt back on once the events that raised it 
+     * have been handled. Returns 0 if there were none.
      */
-    USBHALHandleBusEvent();
+    int handled;
+
+    handled = USBHALHandleBusEvent();
+
+    #ifdef USB_DEV_EVENT_SIGNALED
+    IFS1CLR = USB_INT_BIT;
+    IEC1SET = USB_INT_BIT;
+    #endif
+    return handled;
+}
+
+#ifdef USB_DEV_EVENT_SIGNALED
+void __ISR(_USB1_VECTOR, ipl4) USBHandler(void) {
+    /**
+     * Wake the USB task
+     *
+     * The module keeps the interrupt raised until the stack handles the
+     * event, so it is turned off here and back on in USB_handleEvents.
+     */
+    unsigned int start = ReadCoreTimer();
+
+    IEC1CLR = USB_INT_BIT;
+    IFS1CLR = USB_INT_BIT;
+    SCH_signal(SCH_TASK_USB);
+    TLM_recordIsr(TLM_ISR_USB, start);
 }
+#endif
@@ -19,27 +19,176 @@
 #include "sampling.h"
 #include "mdac.h"
 #include "globals.h"
+#include "telemetry.h"
 
 struct USB_command_packet {
     /// Command to run
     unsigned char command;
     /// Used for a ping request
     unsigned char ping_size;
-    unsigned char unused_char1;
-    unsigned char unused_char2;
+    /// Sequence tag echoed in the reply header (0 for an untagged reply)
+    unsigned char tag;
+    /// Upload start within the upload buffer, in USB_UPLOAD_CHUNK units;
+    /// for CMD_schedule_mdac, bits 16-23 of the sample index
+    unsigned char chunk;
     /// Used for sampling requests
     short int mdac_value;
-    short int unused_short1;
+    /// Milliseconds for the bulk throughput test, bytes for an upload;
+    /// for CMD_schedule_mdac, bits 0-15 of the sample index
+    unsigned short length;
 };
 
+/* The 24 bit sample index CMD_schedule_mdac packs into chunk and length */
+#define USB_COMMAND_INDEX(packet) (((unsigned int)(packet)->chunk << 16) | (packet)->length)
+
+struct USB_reply_header {
+    /// Tag of the command this reply answers
+    unsigned char tag;
+    /// Command this reply answers
+    unsigned char command;
+    /// Number of payload bytes following the header
+    unsigned short length;
+};
+
+struct USB_frame_time_packet {
+    /// 11 bit frame number of the most recent USB start-of-frame
+    unsigned short frame;
+    unsigned short unused_short1;
+    /// Core timer count when that start-of-frame was seen
+    unsigned int frame_time;
+    /// Number of start-of-frames seen since the bus was reset
+    unsigned int frame_count;
+    /// Core timer count when this reply was built
+    unsigned int now;
+    /// Core timer ticks per second
+    unsigned int timer_rate;
+    /// Upper 32 bits of the 64 bit clock when this reply was built (see
+    /// clock.c); now is its lower 32 bits
+    unsigned int now_high;
+};
+
+struct USB_status_packet {
+    /// Current MDAC value (the whole reply before version 2003)
+    int mdac_value;
+    /// Current sampling mode (DEMONSTRATION or SAMPLING)
+    int mode;
+    /// Blocks filled and waiting to be sent
+    int ring_fill;
+    /// Blocks filled since sampling started
+    int blocks_produced;
+    /// Blocks sent since sampling started
+    int blocks_sent;
+    /// Blocks overwritten before they were sent
+    int overruns;
+    /// Longest ADC ISR run time (its body, not the delay before it), 
+    /// in core timer ticks
+    unsigned int adc_isr_max_duration;
+    /// Average ADC ISR run time, in core timer ticks
+    unsigned int adc_isr_avg_duration;
+    /// Scheduler passes per second: task runs plus wake-ups from idle
+    unsigned int loop_rate;
+    /// USBDEV_* bus error bits seen since the last status request
+    unsigned int usb_errors;
+    /// Milliseconds since the PC last asked for data
+    int last_transmission;
+    /// Longest scheduler pass (one task run and the ISRs that interrupted
+    /// it) in the last second, in core timer ticks
+    unsigned int loop_max;
+    /// Per mille of the last second in task runs that did work; polls
+    /// that found nothing to do (e.g. the 1 ms USB signal) don't count
+    unsigned int busy_load;
+    /// Per mille of the last second in ISRs
+    unsigned int isr_load;
+    /// Task runs and ISRs that went over their CPU budget since boot
+    unsigned int over_budget;
+    /// Microseconds from main() to the scheduler starting
+    unsigned int init_time;
+    /// Microseconds from main() to the host's first SETUP packet
+    unsigned int setup_time;
+    /// MDAC words dropped because the SPI queue was full
+    unsigned int mdac_drops;
+};
+
+struct USB_counters_packet {
+    /// Current sampling mode (DEMONSTRATION or SAMPLING)
+    int mode;
+    /// Id of the block currently being sampled
+    int packet_id;
+    /// Buffer the ADC is currently filling
+    int sample_buffer;
+    /// Next buffer to send to the PC
+    int send_buffer;
+    /// Milliseconds since the PC last asked for data
+    int last_transmission;
+};
+
+struct USB_bulk_test_packet {
+    /// 1024 byte blocks sent
+    unsigned int blocks;
+    /// Main loop passes that found the IN endpoint still busy
+    unsigned int stalls;
+    /// Core timer ticks from the start of the test to this reply
+    unsigned int time;
+    /// Core timer ticks per second
+    unsigned int timer_rate;
+};
+
+struct USB_isr_stats_packet {
+    /// Interrupts by log2 of the ticks from request to entry
+    unsigned int latency[TLM_BUCKETS];
+    /// Interrupts by log2 of the ticks spent in the ISR
+    unsigned int duration[TLM_BUCKETS];
+};
+
+struct USB_memory_packet {
+    /// Data RAM
+    unsigned int ram_size;
+    /// Initialized data and bss, all modules
+    unsigned int static_size;
+    /// Reserved for the heap
+    unsigned int heap_size;
+    /// Left for the stack
+    unsigned int stack_size;
+    /// Deepest the stack has been since boot
+    unsigned int stack_used;
+    /// Sample blocks and their states
+    unsigned int sample_buffers;
+    /// Upload buffer (waveform tables)
+    unsigned int upload_buffer;
+    /// USB buffer descriptors, driver state and command/reply buffers
+    unsigned int usb;
+    /// Trace ring, profile and ISR histograms
+    unsigned int diagnostics;
+    /// Static data not counted above
+    unsigned int other;
+};
+
+/* USBIF/USBIE in IFS1/IEC1 */
+#define USB_INT_BIT 0x02000000
+
 extern struct USB_command_packet USB_command;
+extern BYTE USB_upload_buffer[USB_UPLOAD_SIZE];
 
 void USB_init(void);
 int USB_getNextCommand(void);
 void USB_sendAck(void);
+void USB_sendNak(void);
+void USB_sendVersion(void);
 void USB_sendRaw(byte* address, int length);
+void USB_fillStatus(struct USB_status_packet* status);
 void USB_sendStatus();
+void USB_sendFrameTime();
+int USB_sendIsrStats(int isr);
+void USB_fillMemory(struct USB_memory_packet* memory);
+void USB_sendMemory(void);
+BOOL USB_handleVendorRequest(PSETUP_PKT pkt, void **data, unsigned int *length);
 void USB_sendPingReply();
-void USB_handleEvents();
+void USB_startBulkTest(void);
+int USB_bulkTestRunning(void);
+int USB_serviceBulkTest(void);
+void USB_startUpload(void);
+int USB_uploadRunning(void);
+int USB_serviceUpload(void);
+int USB_handleEvents();
 
 #endif
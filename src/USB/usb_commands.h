@@ -15,8 +15,135 @@
 #define CMD_end_sample 0x04
 #define CMD_set_mdac 0x05
 #define CMD_get_version 0x06
+#define CMD_get_frame_time 0x07
+#define CMD_upload 0x08
+#define CMD_wave_start 0x09
+#define CMD_wave_stop 0x0A
+#define CMD_schedule_mdac 0x0B
+#define CMD_uart_stream 0x0C
+#define CMD_isr_stats 0x0D
+#define CMD_profile 0x0E
+#define CMD_profile_dump 0x0F
+#define CMD_trace 0x10
+#define CMD_trace_dump 0x11
+#define CMD_memory 0x12
 
 #define CMD_ping 0x80
 #define CMD_LED_test 0x81
+#define CMD_bulk_test 0x82
 
 #define CMD_none 0xFF
+
+/* Vendor control requests
+ *
+ * These are serviced on endpoint 0 (bRequest of a vendor request), so they
+ * do not queue behind data transfers on the bulk endpoints.
+ */
+
+#define VREQ_set_mdac 0x01      // wValue = new MDAC value, no data stage
+#define VREQ_status 0x02        // IN, same reply as CMD_status
+#define VREQ_counters 0x03      // IN, struct USB_counters_packet
+
+/* Reply tagging
+ *
+ * A command sent with a non-zero tag gets its reply prefixed with a
+ * USB_REPLY_HEADER_SIZE byte header: the tag, the command and the 16 bit
+ * payload length. Commands with a tag of 0 get the bare reply, as before.
+ * CMD_get_data replies are never tagged since each block already carries
+ * its packet id. The block is sent once it has filled, and later commands
+ * wait until it has gone; outside sampling mode the reply is a nak.
+ */
+
+#define USB_REPLY_HEADER_SIZE 4
+#define USB_REPLY_MAX 128       // largest reply payload, before the header
+
+/* Uploads
+ *
+ * CMD_upload is followed by a bulk OUT transfer of length bytes, which 
+ * lands in the device's upload buffer starting at chunk * USB_UPLOAD_CHUNK.
+ * It stops any waveform playing from the buffer.
+ * The transfer ends after length bytes or at a short packet. The device
+ * replies once it has the payload: 0x01 if it was stored, 0x00 if the
+ * request did not fit the buffer (the payload is then read and dropped).
+ */
+
+#define USB_UPLOAD_CHUNK 64
+#define USB_UPLOAD_SIZE 4096
+
+/* Waveform playback
+ *
+ * CMD_wave_start plays the table at the start of the upload buffer: a 
+ * 16 bit code count, a 16 bit mode (0 = one-shot, 1 = loop), a 32 bit 
+ * divider and then the 16 bit MDAC codes. Each code is held for divider
+ * ADC scans, so playback is locked to the sample stream. The divider 
+ * must be at least 2, as SPI2 takes 25.6 us to send a code and a scan 
+ * is 13.2 us. The reply is 0x01, or 0x00 if the table is empty, does 
+ * not fit the buffer or the divider is too small.
+ * CMD_wave_stop stops playback and leaves the MDAC at the last code.
+ */
+
+/* Scheduled MDAC changes
+ *
+ * CMD_schedule_mdac sets the MDAC to mdac_value just before sample number
+ * index of the current capture, counted from CMD_start_sample, and marks
+ * the change in the sample stream. It is answered with 0x00 when the 
+ * device is not sampling.
+ *
+ * The 24 bit index does not fit a field of its own, so it reuses two:
+ *
+ *     chunk   bits 16-23 of the index (not an upload chunk here)
+ *     length  bits 0-15 of the index (not a length here)
+ *
+ * i.e. index = (chunk << 16) | length; see USB_COMMAND_INDEX.
+ */
+
+/* UART sample stream
+ *
+ * CMD_uart_stream with a non-zero length switches the debug UART to 
+ * 2.5 Mbaud and streams sample blocks out of it while sampling; a length
+ * of 0 switches it back. See tools/uart_stream.py for the frame format.
+ */
+
+/* ISR timing
+ *
+ * CMD_isr_stats replies with the histograms of ISR mdac_value (see 
+ * TLM_ISR_* in telemetry.h): 16 32 bit latency counts, then 16 32 bit
+ * duration counts. Count n is for 2^(n-1) to 2^n - 1 core timer ticks 
+ * (count 0 for 0 ticks, the last count for everything longer). A non-zero
+ * length clears all the histograms once the reply is built. Latency is 
+ * only measured for Timer2 and, relative to its fastest period, the ADC;
+ * the other latency counts stay 0. Unknown ISRs get 0x00.
+ */
+
+/* Profiling
+ *
+ * CMD_profile with a length of 10 to 20000 clears the profile and starts
+ * sampling the program counter length times a second; a length of 0 
+ * stops it. Other lengths get 0x00. CMD_profile_dump replies with the
+ * profile: a 32 bit base address, 16 bit log2 bucket size, 16 bit bucket
+ * count, 32 bit sample count, 32 bit count of samples outside the 
+ * buckets and the 32 bit rate (0 once stopped), then a 16 bit count for 
+ * each bucket. Sampling stops by itself when a count reaches 65535. Like
+ * CMD_get_data, the reply is never tagged. See tools/profile.py.
+ */
+
+/* Event trace
+ *
+ * The device keeps the last 128 events (sampling start/end, mode 
+ * changes, blocks filled and sent, overruns, USB transfers and MDAC 
+ * writes, see TRC_* in trace.h). CMD_trace with a length of 0 freezes 
+ * the trace; any other length clears it and starts recording again. 
+ * CMD_trace_dump replies, untagged, with a 32 bit count of events 
+ * recorded, the 32 bit core timer rate, then 128 8 byte records: 32 bit
+ * core timer count, 8 bit event, 8 bit argument a, 16 bit argument b. 
+ * Event n is record n % 128, so the oldest is at count % 128 once the 
+ * trace has wrapped.
+ */
+
+/* Memory
+ *
+ * CMD_memory replies with struct USB_memory_packet (see usb.h): the RAM
+ * size, how it is split between static data, heap and stack, the 
+ * deepest the stack has been since boot, and the static data taken by 
+ * the larger modules. All sizes are in bytes.
+ */
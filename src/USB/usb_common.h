@@ -284,7 +284,9 @@ typedef enum
 This data structure is passed to the appropriate layer's
 USB_EVENT_HANDLER when an EVT_XFER event has occured, indicating
 that a transfer has completed on the USB.  It provides the endpoint,
-direction, and actual size of the transfer.
+direction, and actual size of the transfer.  For a pipe running as a
+ring (see USBHALStartRing) every packet is reported on its own and
+ping_pong identifies the buffer descriptor that received it.
  */
 
 typedef struct _transfer_event_data
@@ -292,6 +294,7 @@ typedef struct _transfer_event_data
     TRANSFER_FLAGS  flags;          // Transfer flags (see above)
     UINT32          size;           // Actual number of bytes transferred
     BYTE            pid;            // Packet ID
+    BYTE            ping_pong;      // Descriptor of the last packet: 0=even/1=odd
 
 } USB_TRANSFER_EVENT_DATA;
 
@@ -30,6 +30,16 @@
 //#define USB_DEV_INTERRUPT_DRIVEN
 
 
+/* USB_DEV_EVENT_SIGNALED
+ *
+ * Polled mode with the USB interrupt turned on so the application can 
+ * sleep until there is bus activity. The application provides the ISR 
+ * (see usb.c); it only wakes whatever calls "USBTasks()", which still 
+ * runs outside interrupt context. Not used with USB_DEV_INTERRUPT_DRIVEN.
+ */
+#define USB_DEV_EVENT_SIGNALED
+
+
 /* USB_DEV_EVENT_HANDLER
  *
  * This macro defines the name of the bus-event-handling function for the
@@ -127,6 +137,16 @@
 #define USB_DEV_GET_FUNCTION_DRIVER_TABLE_FUNC USBDEVGetFunctionDriverTable
 
 
+/* USB_DEV_VENDOR_REQUEST_FUNC
+ *
+ * This macro defines the name of the routine that services vendor
+ * specific control requests on endpoint 0.  It is optional; when it is
+ * not defined, vendor requests are passed on to the function drivers.
+ */
+
+#define USB_DEV_VENDOR_REQUEST_FUNC USB_handleVendorRequest
+
+
 /**************
  * Miscellany *
  **************/
@@ -161,6 +181,16 @@
  
 #define USB_SAFE_MODE
 
+
+/* USB_DEVICE_ENABLE_SOF_EVENTS
+ *
+ * Define this macro to have the HAL service the Start-Of-Frame token
+ * interrupt.  Each SOF records the 11-bit frame number against the core
+ * timer so the host can correlate device time with bus time.
+ */
+
+#define USB_DEVICE_ENABLE_SOF_EVENTS
+
 #if defined(__18CXX)
     #define LANGID_LENGTH 1
     #define STRING_LENGH 1
@@ -10,6 +10,8 @@
 
 #include "GenericTypeDefs.h"
 #include "USB/usb.h"
+#include "trace.h"
+#include "telemetry.h"
 
 #include "usb_device_local.h"
 
@@ -20,10 +22,6 @@
 #define NAME_LEN                32
 // NUM_CALLS * NAME_LEN = call trace buffer size
 
-// State Trace
-//#define ENABLE_STATE_TRACE
-#define NUM_STATES              20
-
 // Event Trace
 //#define ENABLE_EVENT_TRACE
 #define NUM_EVENTS              40
@@ -46,16 +44,6 @@ int  gCTIndex;
 #define mCALL_TRACE(s)  
 #endif
 
-// State Trace
-#ifdef ENABLE_STATE_TRACE
-struct _state_trace
-{
-    EP0_STATE     state;
-    XFER_FLAGS    flags;
-} gStateTrace[NUM_STATES];
-int gStateIndex;
-#endif
-
 // Event Trace
 #ifdef ENABLE_EVENT_TRACE
 typedef struct _event_trace
@@ -615,16 +603,76 @@ PRIVATE BOOL HandleGetInterfaceRequest ( BYTE interface )
 
 
 
+#ifdef USB_DEV_VENDOR_REQUEST_FUNC
+
+/* HandleVendorRequest
+ *************************************************************************
+ * This routine lets the application service a vendor specific request
+ * and runs the data and status stages of the control transfer on EP0.
+ */
+
+PRIVATE BOOL HandleVendorRequest ( PSETUP_PKT pkt )
+{
+    void         *data = NULL;
+    unsigned int  size = 0;
+    BOOL          success;
+
+    mCALL_TRACE("HandleVendorRequest");
+
+    // Host-to-device requests with a data stage are not supported.
+    success = pkt->requestInfo.direction || pkt->wLength == 0;
+
+    // Let the application service the request.
+    if (!success || !USB_DEV_VENDOR_REQUEST_FUNC(pkt, &data, &size))
+    {
+        // Stall the pipe if the request is not supported.
+        gDEVData.ep0_state = EP0_STALLED;
+        USBHALStallPipe(XFLAGS(USB_EP0|USB_TRANSMIT));
+        USBHALTransferData(XFLAGS(USB_SETUP_PKT), &gDEVData.ep0_buffer, sizeof(SETUP_PKT));
+        return FALSE;
+    }
+
+    // Device-to-host: send the data, then receive the status stage.
+    if (pkt->requestInfo.direction)
+    {
+        // Send the smaller of the requested or actual length of the data.
+        size = min(size, pkt->wLength);
+
+        gDEVData.ep0_state = EP0_SENDING_DESC;
+        success = USBHALTransferData(XFLAGS(USB_SETUP_DATA|USB_TRANSMIT), data, size);
+
+        // Prepare now to receive the status packet in case host cuts us short.
+        gDEVData.ep0_state = EP0_WAITING_RX_STATUS;
+        return success && USBHALTransferData(XFLAGS(USB_SETUP_STATUS|USB_RECEIVE), NULL, 0);
+    }
+
+    // Host-to-device: send the status packet.
+    gDEVData.ep0_state = EP0_WAITING_TX_STATUS;
+    return USBHALTransferData(XFLAGS(USB_SETUP_STATUS|USB_TRANSMIT), NULL, 0);
+
+} // HandleVendorRequest
+
+#endif // USB_DEV_VENDOR_REQUEST_FUNC
+
+
 /* HandleNonstandardRequests
  *************************************************************************
  * Handles requests that are not for the device layer by passing them
- * along to the higher layers.
+ * along to the higher layers.  Vendor requests are given to the 
+ * application's vendor request handler, if there is one, so that they
+ * are serviced on EP0 without waiting behind the function's endpoints.
  */
 
 PRIVATE BOOL HandleNonstandardRequests ( PSETUP_PKT pkt )
 {
     mCALL_TRACE("HandleNonstandardRequests");
 
+    #ifdef USB_DEV_VENDOR_REQUEST_FUNC
+    if ((pkt->requestInfo.bmRequestType & 0x60) == USB_SETUP_TYPE_VENDOR) {
+        return HandleVendorRequest(pkt);
+    }
+    #endif
+
     // Pass it to the higher layers.
     if (PassEventToAllFunctions(EVENT_SETUP, pkt, sizeof(SETUP_PKT)))
     {
@@ -818,6 +866,9 @@ BOOL HandleDeviceRequest ( void )
     // Get EP0 setup packet buffer.
     pkt = (PSETUP_PKT)&gDEVData.ep0_buffer;
 
+    // time to enumeration, see TLM_recordSetup
+    TLM_recordSetup();
+
     // If it's not a standard request, pass it along.
     if (pkt->requestInfo.type != USB_SETUP_TYPE_STANDARD) {
         return HandleNonstandardRequests(pkt);
@@ -954,12 +1005,7 @@ PRIVATE BOOL HandleDataTransferEvent ( USB_TRANSFER_EVENT_DATA *xfer )
 
     mCALL_TRACE("HandleDataTransferEvent");
 
-    // Debug Only
-    #ifdef ENABLE_STATE_TRACE
-    gStateTrace[gStateIndex].state = gDEVData.ep0_state;
-    gStateTrace[gStateIndex].flags = xfer->flags;
-    gStateIndex = (gStateIndex + 1) % NUM_STATES;
-    #endif
+    TRC_record(TRC_USB_DONE, xfer->flags.bitmap, xfer->size);
 
     // Is it an endpoint 0 transfer that just completed?
     if (xfer->flags.field.ep_num == 0)
@@ -172,6 +172,45 @@ Remarks:        Since this routine is implemented by the application, its name
 const FUNC_DRV *USB_DEV_GET_FUNCTION_DRIVER_TABLE_FUNC ( void );
 
 
+/*******************************************************************************
+Function:       BOOL USB_DEV_VENDOR_REQUEST_FUNC ( PSETUP_PKT pkt, void **data,
+                        unsigned int *length )
+
+Preconditions:  The device has been enumerated on the USB by the host.
+
+Overview:       This function is an optional "call out" from the USB FW stack.
+                The USB device support will call it when a vendor specific
+                setup request is received on endpoint 0 so that the request 
+                is serviced independently of the function driver endpoints.
+
+Input:          PSETUP_PKT pkt - The setup packet received.
+
+Output:         void **data - Data to send to the host for device-to-host 
+                              requests.  Must stay valid until the transfer
+                              completes.
+                              
+                unsigned int *length - Length of the data to send.
+
+Return Values:  TRUE  - If the request was handled
+                FALSE - If the request is not supported (EP0 is stalled)
+
+Remarks:        Host-to-device requests cannot have a data stage; all of 
+                their parameters must fit in wValue and wIndex.
+
+                Since this routine is implemented by the application, its name
+                is identified to the device abstraction layer be defining the
+                USB_DEV_VENDOR_REQUEST_FUNC macro in the "usb_config.h" file.
+                
+                Example:  
+                
+                #define USB_DEV_VENDOR_REQUEST_FUNC USB_handleVendorRequest
+*******************************************************************************/
+
+#ifdef USB_DEV_VENDOR_REQUEST_FUNC
+BOOL USB_DEV_VENDOR_REQUEST_FUNC ( PSETUP_PKT pkt, void **data, unsigned int *length );
+#endif
+
+
 // *****************************************************************************
 // *****************************************************************************
 // Section: Function Driver Interface
@@ -439,6 +478,58 @@ Remarks:        None
 BOOL USBDEVUnstallPipe( TRANSFER_FLAGS pipe );
 
 
+/*******************************************************************************
+Function:       BOOL USBDEVStartRing( TRANSFER_FLAGS pipe, unsigned int size,
+                                      BYTE *ping_pong )
+
+Preconditions:  USBInitialize must have been called to initialize the USB FW 
+                stack and the endpoint must have been configured.
+
+Overview:       This routine switches a pipe into ring mode.  Both ping-pong
+                descriptors are then armed separately (USBDEVArmRingPacket)
+                and every packet is reported in its own EVENT_TRANSFER event.
+
+Input:          TRANSFER_FLAGS pipe - Identifies the endpoint and direction.
+                unsigned int size   - Size of each buffer armed on the pipe.
+
+Output:         BYTE *ping_pong     - Descriptor receiving the first packet.
+
+Return Values:  TRUE  - If successful.
+                FALSE - If the pipe is busy.
+
+Remarks:        None
+*******************************************************************************/
+
+#define USBDEVStartRing USBHALStartRing     // Implemented by the HAL
+
+BOOL USBDEVStartRing( TRANSFER_FLAGS pipe, unsigned int size, BYTE *ping_pong );
+
+
+/*******************************************************************************
+Function:       BOOL USBDEVArmRingPacket( TRANSFER_FLAGS pipe, BYTE ping_pong,
+                                          void *buffer )
+
+Preconditions:  USBDEVStartRing must have been called on the pipe.
+
+Overview:       This routine hands one descriptor of a ring pipe to the HW.
+
+Input:          TRANSFER_FLAGS pipe - Identifies the endpoint and direction.
+                BYTE ping_pong      - Descriptor to arm (0=even/1=odd).
+                void *buffer        - Buffer for the packet.
+
+Output:         None - None
+
+Return Values:  TRUE  - If successful.
+                FALSE - If the HW still owns the descriptor.
+
+Remarks:        None
+*******************************************************************************/
+
+#define USBDEVArmRingPacket USBHALArmRingPacket     // Implemented by the HAL
+
+BOOL USBDEVArmRingPacket( TRANSFER_FLAGS pipe, BYTE ping_pong, void *buffer );
+
+
 /*******************************************************************************
 Function:       BOOL USBDEVInitialize ( unsigned long flags )
 
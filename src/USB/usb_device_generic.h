@@ -87,7 +87,7 @@ BOOL USBGenTxIsBusy( void );
 
 
 /******************************************************************************
- Function:        byte USBGenGetRxLength(void)
+ Function:        UINT16 USBGenGetRxLength(void)
 
  PreCondition:    None
 
@@ -104,7 +104,48 @@ BOOL USBGenTxIsBusy( void );
  Note:            None
  *****************************************************************************/
 
-BYTE USBGenGetRxLength( void );
+UINT16 USBGenGetRxLength( void );
+
+
+/******************************************************************************
+ Function:        unsigned long USBGenGetErrors(void)
+
+ PreCondition:    None
+
+ Input:           None
+
+ Output:          Bitmap of the USBDEV_* errors seen since the last call.
+
+ Side Effects:    The error record is cleared.
+
+ Overview:        USBGenGetErrors reports the bus errors collected from
+                  EVENT_BUS_ERROR events, along with any the HAL has not
+                  reported yet.
+
+ Note:            None
+ *****************************************************************************/
+
+unsigned long USBGenGetErrors( void );
+
+
+/******************************************************************************
+ Function:        unsigned int USBGenGetRamUse(void)
+
+ PreCondition:    None
+
+ Input:           None
+
+ Output:          Bytes of RAM used by the function driver's state and its
+                  receive ring.
+
+ Side Effects:    None
+
+ Overview:        For the firmware's RAM report.
+
+ Note:            None
+ *****************************************************************************/
+
+unsigned int USBGenGetRamUse( void );
 
 
 /******************************************************************************
@@ -144,7 +185,7 @@ void USBGenWrite(BYTE *buffer, unsigned int len);
 
 
 /******************************************************************************
- Function:        byte USBGenRead(bytebuffer, byte len)
+ Function:        UINT16 USBGenRead(bytebuffer, unsigned int len)
 
  Preconditions:   1. USBInitialize must have been called to initialize 
                   the USB SW Stack.
@@ -177,9 +218,54 @@ void USBGenWrite(BYTE *buffer, unsigned int len);
                   If the actual number of bytes received is smaller than the
                   number of bytes expected (len), only the actual number
                   of bytes received will be copied to buffer.
+                  A single transfer may be up to 65535 bytes long.
+ *****************************************************************************/
+
+UINT16 USBGenRead(BYTE *buffer, unsigned int len);
+
+
+/******************************************************************************
+ Function:        BYTE *USBGenGetPacket(unsigned int *len)
+
+ Preconditions:   The host must have configured the system as a USB device
+                  that includes the Microchip General function interface.
+
+ Input:           None
+
+ Output:          len     : Size of the packet returned.
+
+ Side Effects:    The first call switches the OUT endpoint into a ring with
+                  both ping-pong descriptors armed.
+
+ Overview:        Returns the oldest packet received on the OUT endpoint,
+                  or NULL if none is waiting.  The packet stays valid until
+                  USBGenReleasePacket is called.
+
+ Note:            Do not mix with USBGenRead.
+ *****************************************************************************/
+
+BYTE *USBGenGetPacket(unsigned int *len);
+
+
+/******************************************************************************
+ Function:        void USBGenReleasePacket(BYTE *buffer)
+
+ Preconditions:   USBGenGetPacket returned a packet.
+
+ Input:           buffer  : Buffer to re-arm the descriptor with, or NULL 
+                            for the driver's own buffer.
+
+ Output:          None
+
+ Side Effects:    The descriptor that held the packet is armed again.
+
+ Overview:        Hands the packet returned by USBGenGetPacket back to the
+                  ring.
+
+ Note:            None
  *****************************************************************************/
 
-BYTE USBGenRead(BYTE *buffer, unsigned int len);
+void USBGenReleasePacket(BYTE *buffer);
 
 
 /** O B S O L E T E **********************************************************/
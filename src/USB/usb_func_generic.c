@@ -15,6 +15,9 @@
  
 PRIVATE GEN_FUNC gGenFunc;  // State structure
 
+// Packet buffers for the OUT endpoint ring.
+PRIVATE BYTE __attribute__ ((aligned(4))) gGenRxRing[2][GEN_FUNC_RING_PKT_SIZE];
+
  
 /***************************
  * Local Utility Functions *
@@ -51,9 +54,17 @@ PRIVATE inline BOOL HandleTransferDone( USB_TRANSFER_EVENT_DATA * xfer )
         // Did a receive transfer finish?
         if ( xfer->flags.field.direction == 0)  // Receive
         {
+            // Ring packets are queued on their descriptor.
+            if (gGenFunc.flags & GEN_FUNC_FLAG_RX_RING)
+            {
+                gGenFunc.rx_len[xfer->ping_pong & 1] = (BYTE)xfer->size;
+                gGenFunc.rx_full |= 1 << (xfer->ping_pong & 1);
+                return TRUE;
+            }
+
             // Yes, Set the the Rx-data-available flag & record the size.
             gGenFunc.flags |= GEN_FUNC_FLAG_RX_AVAIL;
-            gGenFunc.rx_size = (BYTE)xfer->size;
+            gGenFunc.rx_size = (UINT16)xfer->size;
             return TRUE;
         }
     }
@@ -106,6 +117,10 @@ PUBLIC BOOL USBGenInitialize ( unsigned long flags )
         gGenFunc.ep_num = 1;
     }
 
+    // Drop anything still armed on the OUT endpoint.
+    USBHALFlushPipe(XFLAGS(USB_RECEIVE|gGenFunc.ep_num));
+    gGenFunc.rx_full = 0;
+
     // Set initialized flag!
     gGenFunc.flags   = GEN_FUNC_FLAG_INITIALIZED;
 
@@ -178,8 +193,8 @@ PUBLIC BOOL USBGenEventHandler ( USB_EVENT event, void *data, unsigned int size
 
         
     case EVENT_BUS_ERROR:   // Error on the bus, call USBDEVGetLastError()
-        USBDEVGetLastError();
-        // To Do: Capture the error and do something about it.
+        // Keep the error bits for the application to report.
+        gGenFunc.errors |= USBDEVGetLastError();
         return TRUE;
 
     default:            // Unknown event
@@ -264,7 +279,7 @@ PUBLIC inline BOOL USBGenTxIsBusy( void )
 
 
 /******************************************************************************
- Function:        byte USBGenGetRxLength(void)
+ Function:        UINT16 USBGenGetRxLength(void)
 
  PreCondition:    None
 
@@ -280,12 +295,62 @@ PUBLIC inline BOOL USBGenTxIsBusy( void )
 
  Note:            None
  *****************************************************************************/
-PUBLIC inline BYTE USBGenGetRxLength( void )
+PUBLIC inline UINT16 USBGenGetRxLength( void )
 {
     return gGenFunc.rx_size;
 }
 
 
+/******************************************************************************
+ Function:        unsigned long USBGenGetErrors(void)
+
+ PreCondition:    None
+
+ Input:           None
+
+ Output:          Bitmap of the USBDEV_* errors seen since the last call.
+
+ Side Effects:    The error record is cleared.
+
+ Overview:        USBGenGetErrors reports the bus errors collected from
+                  EVENT_BUS_ERROR events, along with any the HAL has not
+                  reported yet.
+
+ Note:            gGenFunc.errors is not cleared when the function is 
+                  re-initialized, so errors that cause a reset are kept.
+ *****************************************************************************/
+PUBLIC unsigned long USBGenGetErrors( void )
+{
+    unsigned long errors;
+
+    errors = gGenFunc.errors | USBDEVGetLastError();
+    gGenFunc.errors = 0;
+    return errors;
+}
+
+
+/******************************************************************************
+ Function:        unsigned int USBGenGetRamUse(void)
+
+ PreCondition:    None
+
+ Input:           None
+
+ Output:          Bytes of RAM used by the function driver's state and its
+                  receive ring.
+
+ Side Effects:    None
+
+ Overview:        For the firmware's RAM report.
+
+ Note:            None
+ *****************************************************************************/
+PUBLIC unsigned int USBGenGetRamUse( void )
+{
+    return sizeof(gGenFunc) + sizeof(gGenRxRing);
+}
+
+
 /******************************************************************************
  Function:        void USBGenWrite(bytebuffer, byte len)
 
@@ -349,7 +414,7 @@ PUBLIC void USBGenWrite( BYTE *buffer, unsigned int len )
 
 
 /******************************************************************************
- Function:        byte USBGenRead(bytebuffer, byte len)
+ Function:        UINT16 USBGenRead(bytebuffer, unsigned int len)
 
  Preconditions:   1. USBInitialize must have been called to initialize 
                   the USB SW Stack.
@@ -382,8 +447,9 @@ PUBLIC void USBGenWrite( BYTE *buffer, unsigned int len )
                   If the actual number of bytes received is smaller than the
                   number of bytes expected (len), only the actual number
                   of bytes received will be copied to buffer.
+                  A single transfer may be up to 65535 bytes long.
  *****************************************************************************/
-PUBLIC BYTE USBGenRead( BYTE *buffer, unsigned int len )
+PUBLIC UINT16 USBGenRead( BYTE *buffer, unsigned int len )
 {
     // Abort if not initialized.
     if ( !(gGenFunc.flags & GEN_FUNC_FLAG_INITIALIZED) ) {
@@ -416,6 +482,103 @@ PUBLIC BYTE USBGenRead( BYTE *buffer, unsigned int len )
 }
 
 
+/******************************************************************************
+ Function:        BYTE *USBGenGetPacket(unsigned int *len)
+
+ Preconditions:   1. USBInitialize must have been called to initialize 
+                  the USB SW Stack.
+
+                  2. The host must have configured the system as a USB
+                  device that includes the Microchip General function
+                  interface. 
+
+ Input:           None
+
+ Output:          len     : Size of the packet returned.
+
+ Side Effects:    The first call switches the OUT endpoint into a ring with
+                  both ping-pong descriptors armed.
+
+ Overview:        USBGenGetPacket returns the oldest packet received on the
+                  OUT endpoint ring, or NULL if none is waiting.  The 
+                  packet stays valid until USBGenReleasePacket is called.
+                  Both descriptors are armed while the caller works, so the
+                  host can queue the next packet without waiting for it.
+
+ Note:            Do not mix with USBGenRead; the ring keeps the OUT 
+                  endpoint until the function is re-initialized.
+ *****************************************************************************/
+PUBLIC BYTE *USBGenGetPacket( unsigned int *len )
+{
+    // Abort if not initialized.
+    if ( !(gGenFunc.flags & GEN_FUNC_FLAG_INITIALIZED) ) {
+        return NULL;
+    }
+
+    // Start the ring with both descriptors on our own buffers.
+    if ( !(gGenFunc.flags & GEN_FUNC_FLAG_RX_RING) )
+    {
+        if (!USBDEVStartRing(XFLAGS(USB_RECEIVE|gGenFunc.ep_num), GEN_FUNC_RING_PKT_SIZE, &gGenFunc.rx_next)) {
+            return NULL;
+        }
+        gGenFunc.flags     |= GEN_FUNC_FLAG_RX_RING;
+        gGenFunc.rx_full    = 0;
+        gGenFunc.rx_buf[0]  = gGenRxRing[0];
+        gGenFunc.rx_buf[1]  = gGenRxRing[1];
+        USBDEVArmRingPacket(XFLAGS(USB_RECEIVE|gGenFunc.ep_num), gGenFunc.rx_next, gGenFunc.rx_buf[gGenFunc.rx_next]);
+        USBDEVArmRingPacket(XFLAGS(USB_RECEIVE|gGenFunc.ep_num), gGenFunc.rx_next ^ 1, gGenFunc.rx_buf[gGenFunc.rx_next ^ 1]);
+        return NULL;
+    }
+
+    // Packets complete alternately, so only the next one can be ready.
+    if ( !(gGenFunc.rx_full & (1 << gGenFunc.rx_next)) ) {
+        return NULL;
+    }
+
+    *len = gGenFunc.rx_len[gGenFunc.rx_next];
+    return gGenFunc.rx_buf[gGenFunc.rx_next];
+}
+
+
+/******************************************************************************
+ Function:        void USBGenReleasePacket(BYTE *buffer)
+
+ Preconditions:   USBGenGetPacket returned a packet.
+
+ Input:           buffer  : Buffer to re-arm the descriptor with (at least
+                            GEN_FUNC_RING_PKT_SIZE bytes), or NULL for 
+                            the driver's own buffer.
+
+ Output:          None
+
+ Side Effects:    The descriptor that held the packet is armed again.
+
+ Overview:        USBGenReleasePacket hands the packet returned by 
+                  USBGenGetPacket back to the ring.  Passing a buffer 
+                  lets the caller have the packet after next received 
+                  straight into its own memory.
+
+ Note:            None
+ *****************************************************************************/
+PUBLIC void USBGenReleasePacket( BYTE *buffer )
+{
+    BYTE pp = gGenFunc.rx_next;
+
+    if ( !(gGenFunc.rx_full & (1 << pp)) ) {
+        return;
+    }
+
+    if (buffer == NULL) {
+        buffer = gGenRxRing[pp];
+    }
+
+    gGenFunc.rx_full   &= ~(1 << pp);
+    gGenFunc.rx_buf[pp] = buffer;
+    gGenFunc.rx_next    = pp ^ 1;
+    USBDEVArmRingPacket(XFLAGS(USB_RECEIVE|gGenFunc.ep_num), pp, buffer);
+}
+
+
 /*************************************************************************
  * EOF usbgen.c
  */
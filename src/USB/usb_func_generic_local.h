@@ -19,15 +19,24 @@
 typedef struct _generic_usb_fun_data
 {
     BYTE    flags;      // Current state flags.
-    BYTE    rx_size;    // Number of bytes received.
     BYTE    ep_num;     // Endpoint number.
+    UINT16  rx_size;    // Number of bytes received.
+    unsigned long errors; // Bus errors seen since last read.
+    BYTE    rx_next;    // Ring descriptor holding the next packet.
+    BYTE    rx_full;    // Ring descriptors holding unread packets (bitmap).
+    BYTE    rx_len[2];  // Size of the packet on each ring descriptor.
+    BYTE   *rx_buf[2];  // Buffer each ring descriptor is armed with.
 
 } GEN_FUNC, *PGEN_FUNC;
 
+// Size of the packet buffers kept armed on the OUT endpoint.
+#define GEN_FUNC_RING_PKT_SIZE      64
+
 // Generic USB Function State Flags:
 #define GEN_FUNC_FLAG_TX_BUSY       0x01    // Tx is currently busy
 #define GEN_FUNC_FLAG_RX_BUSY       0x02    // Rx is currently busy
 #define GEN_FUNC_FLAG_RX_AVAIL      0x04    // Data has been received
+#define GEN_FUNC_FLAG_RX_RING       0x08    // Rx runs as a packet ring
 #define GEN_FUNC_FLAG_INITIALIZED   0x80    // Function initialized
 
 
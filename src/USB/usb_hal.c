@@ -10,6 +10,7 @@
 #include "plib.h"
 #include "GenericTypeDefs.h"
 #include "USB/usb.h"
+#include "trace.h"
 #include "usb_hal_local.h"
 
 /* Global Data
@@ -353,8 +354,25 @@ LOCAL_INLINE void ServiceEndpoint ( void )
     }
     
     // Assemble transfer flags for endpoint number and direction
+    xfer_data.flags.bitmap          = 0;
     xfer_data.flags.field.ep_num    = pkt_id.field.ep_num;
     xfer_data.flags.field.direction = pkt_id.field.direction;
+    xfer_data.ping_pong             = pkt_id.field.ping_pong;
+
+    // Ring pipes report every packet and leave re-arming to the caller.
+    if (p_Pipe->flags.field.ring)
+    {
+        // Track where the HW goes next so a flush leaves the pipe in sync.
+        p_Pipe->flags.field.ping_pong   = pkt_id.field.ping_pong ^ 1;
+        p_Pipe->flags.field.data_toggle = pkt_id.field.data_toggle ^ 1;
+
+        xfer_data.flags.field.dts = pkt_id.field.data_toggle;
+        xfer_data.pid             = pkt_id.field.pid;
+        xfer_data.size            = pkt_size;
+
+        NotifyHigherLayerOfEvent(EVENT_TRANSFER, &xfer_data, sizeof(xfer_data));
+        return;
+    }
 
     // We're done if there's no data remaining or we've received a short packet.
     if ( (p_Pipe->count == p_Pipe->size) || (pkt_size < p_Pipe->max_pkt_size) )
@@ -412,6 +430,11 @@ LOCAL_INLINE void ServiceEndpoint ( void )
 
 LOCAL_INLINE void SOFHandler( void )
 {
+    // Record the frame number against the core timer.
+    gHALData.sof_time  = ReadCoreTimer();
+    gHALData.sof_frame = (UINT16)((U1FRMH & 0x07) << 8) | (U1FRML & 0xFF);
+    gHALData.sof_count++;
+
     // Notify the host or device layer (as appropriate).
     NotifyHigherLayerOfEvent(EVENT_SOF, NULL, 0);
 
@@ -619,7 +642,7 @@ LOCAL_INLINE void TimerHandler( void )
  *
  * Output:          none
  *
- * Returns:         none
+ * Returns:         TRUE if there was an event to handle
  *
  * Side Effects:    Depend on the event that may have occured.
  *
@@ -631,9 +654,10 @@ LOCAL_INLINE void TimerHandler( void )
  * Note:            This routine is the core of the USB HAL state machine.
  *************************************************************************/
 
-PUBLIC void USBHALHandleBusEvent ( void )
+PUBLIC BOOL USBHALHandleBusEvent ( void )
 {
     UINT32 status;
+    BOOL   handled = FALSE;
 
 
     //
@@ -644,6 +668,7 @@ PUBLIC void USBHALHandleBusEvent ( void )
     if (U1OTGIRbits.T1MSECIF)
     {
         TimerHandler();
+        handled = TRUE;
     }
 
     // Watch VBus for detach.
@@ -651,6 +676,7 @@ PUBLIC void USBHALHandleBusEvent ( void )
     if (gHALData.attached && !U1OTGSTATbits.SESVD)
     {
         DetachHandler();
+        handled = TRUE;
     }
 
     // If the active interrupt has been enabled, disable it
@@ -664,7 +690,7 @@ PUBLIC void USBHALHandleBusEvent ( void )
     // Get status of enabled interrupts.
     if( (status = STATUS_MASK & USBHALGetStatus()) == 0 )
     {
-       return;  // Early exit when no state change.
+       return handled;  // Early exit when no state change.
     }
 
     // Service USB Start-Of-Frame Token Interrupt
@@ -716,6 +742,7 @@ PUBLIC void USBHALHandleBusEvent ( void )
     // Clear the interrupt status
     USBHALClearStatus(status);
 
+    return TRUE;
 
 } // USBHALHandleBusEvent
 
@@ -1090,6 +1117,72 @@ PUBLIC unsigned long USBHALGetLastError( void )
 }   // USBHALGetLastError
 
 
+#if defined(USB_DEVICE_ENABLE_SOF_EVENTS)
+
+/*************************************************************************
+ * Function:        USBHALGetFrameTime
+ *
+ * Precondition:    USBInitialize must have been called to initialize the 
+ *                  USB SW stack.
+ *
+ * Input:           none
+ *
+ * Output:          frame       11-bit frame number of the most recent SOF
+ *
+ *                  time        Core timer count when that SOF was seen
+ *
+ *                  count       Number of SOFs seen since the HAL was
+ *                              (re)initialized
+ *
+ * Returns:         none
+ *
+ * Side Effects:    none
+ *
+ * Overview:        This routine provides the most recent Start-Of-Frame
+ *                  frame number and the core timer count it was seen at.
+ *
+ * Note:            In polled mode the SOF is seen the next time 
+ *                  USBHALHandleBusEvent runs, so the time carries the 
+ *                  main loop latency on top of the 1ms frame period.
+ *************************************************************************/
+
+PUBLIC void USBHALGetFrameTime( UINT16 *frame, UINT32 *time, UINT32 *count )
+{
+    *frame = gHALData.sof_frame;
+    *time  = gHALData.sof_time;
+    *count = gHALData.sof_count;
+
+}   // USBHALGetFrameTime
+
+#endif
+
+
+/*************************************************************************
+ * Function:        USBHALGetRamUse
+ *
+ * Precondition:    none
+ *
+ * Input:           none
+ *
+ * Output:          none
+ *
+ * Returns:         Bytes of RAM used by the buffer descriptor table 
+ *                  (g_BDT) and the HAL's data
+ *
+ * Side Effects:    none
+ *
+ * Overview:        For the firmware's RAM report. g_BDT must be 512 
+ *                  byte aligned, so the linker may leave a gap before it
+ *                  that is not counted here.
+ *************************************************************************/
+
+PUBLIC UINT32 USBHALGetRamUse( void )
+{
+    return sizeof(g_BDT) + sizeof(gHALData);
+
+}   // USBHALGetRamUse
+
+
 /*************************************************************************
  * Function:        USBHALTransferData
  *
@@ -1141,6 +1234,8 @@ PUBLIC BOOL USBHALTransferData ( TRANSFER_FLAGS    flags,
     PUSB_HAL_PIPE   p_Pipe;                 // Pointer to pipe data
 
 
+    TRC_record(TRC_USB_START, flags.bitmap, size);
+
     // Find the pipe data.
     p_Pipe = FindPipe(flags.field.ep_num, flags.field.direction);
 
@@ -1151,7 +1246,7 @@ PUBLIC BOOL USBHALTransferData ( TRANSFER_FLAGS    flags,
         }
     
         // Make sure it's not currently in use.
-        if (p_Pipe->buffer != NULL) {
+        if (p_Pipe->buffer != NULL || p_Pipe->flags.field.ring) {
             return FALSE;
         }
     
@@ -1274,8 +1369,9 @@ PUBLIC BOOL USBHALFlushPipe( TRANSFER_FLAGS pipe )
     desc->setup.Val    = 0;
     desc->byte_cnt.BC  = 0;
 
-    // Update the ping-pong tracking if needed
-    if (Val & USBHAL_DESC_UOWN)
+    // Update the ping-pong tracking if needed (ring pipes track the HW
+    // directly as each packet completes).
+    if ((Val & USBHAL_DESC_UOWN) && !p_Pipe->flags.field.ring)
     {
         p_Pipe->flags.field.ping_pong ^= 1;
     }
@@ -1292,12 +1388,164 @@ PUBLIC BOOL USBHALFlushPipe( TRANSFER_FLAGS pipe )
     p_Pipe->remaining = 0;
     p_Pipe->count     = 0;
     p_Pipe->buffer    = NULL;
+    p_Pipe->flags.field.ring = 0;
 
     return TRUE;
 
 }   // USBHALFlushPipe
 
 
+/******************************************************************************
+ * Function:        USBHALStartRing
+ *
+ * Preconditions:   USBHALInitialize must have been called to initialize the 
+ *                  USB HAL and the endpoint must have been configured by a
+ *                  call to USBHALSetEpConfiguration.
+ *
+ * Input:           pipe        Uses the TRANSFER_FLAGS (see USBCommon.h)
+ *                              format to identify the endpoint and direction
+ *                              making up the pipe.
+ *
+ *                  size        Size of each buffer that will be armed on 
+ *                              the pipe (at most the endpoint's max packet
+ *                              size).
+ *
+ * Output:          ping_pong   The descriptor (0=even/1=odd) that will 
+ *                              receive the first packet.
+ *
+ * Returns:         TRUE if successful, FALSE if the pipe is busy.
+ *
+ * Side Effects:    The pipe has been switched into ring mode.
+ *
+ * Overview:        This routine switches a pipe from transfer mode to ring
+ *                  mode.  In ring mode the even and odd descriptors are armed
+ *                  independently with USBHALArmRingPacket, each packet is 
+ *                  reported by its own EVENT_TRANSFER event (carrying the 
+ *                  descriptor it arrived on) and the descriptor stays idle 
+ *                  until the caller arms it again.  Keeping both descriptors
+ *                  armed lets the HW accept the next packet while the caller
+ *                  is still busy with the last one.
+ *
+ * Note:            Packets always complete alternately on the even and odd
+ *                  descriptors.  The pipe stays in ring mode until it is 
+ *                  flushed or the HAL is reinitialized.
+ *****************************************************************************/
+
+PUBLIC BOOL USBHALStartRing( TRANSFER_FLAGS pipe, unsigned int size, BYTE *ping_pong )
+{
+    PUSB_HAL_PIPE   p_Pipe;     // Pointer to pipe data
+    pBUF_DESC       desc;
+
+
+    // Range check the BDT index
+    #ifdef USB_SAFE_MODE
+    if (pipe.field.ep_num > USB_DEV_HIGHEST_EP_NUMBER) {
+        return FALSE;
+    }
+    #endif
+
+    // Find the pipe data.
+    p_Pipe = FindPipe(pipe.field.ep_num, pipe.field.direction);
+
+    // Make sure it's not currently in use.
+    if (p_Pipe->buffer != NULL || p_Pipe->flags.field.ring) {
+        return FALSE;
+    }
+
+    if (size > p_Pipe->max_pkt_size) {
+        return FALSE;
+    }
+
+    // Seed each descriptor with the data toggle of the first packet it will
+    // receive.  USBHALArmRingPacket carries it forward from there.
+    desc = FindDescriptor(pipe.field.ep_num, pipe.field.direction, p_Pipe->flags.field.ping_pong);
+    if (desc->setup.Val & USBHAL_DESC_UOWN) {
+        return FALSE;
+    }
+    desc->setup.Val = p_Pipe->flags.field.data_toggle << 6;
+
+    desc = FindDescriptor(pipe.field.ep_num, pipe.field.direction, p_Pipe->flags.field.ping_pong ^ 1);
+    if (desc->setup.Val & USBHAL_DESC_UOWN) {
+        return FALSE;
+    }
+    desc->setup.Val = (p_Pipe->flags.field.data_toggle ^ 1) << 6;
+
+    // Record the buffer size.
+    p_Pipe->size      = size;
+    p_Pipe->remaining = 0;
+    p_Pipe->count     = 0;
+    p_Pipe->flags.field.ring = 1;
+
+    *ping_pong = p_Pipe->flags.field.ping_pong;
+
+    return TRUE;
+
+}   // USBHALStartRing
+
+
+/******************************************************************************
+ * Function:        USBHALArmRingPacket
+ *
+ * Preconditions:   USBHALStartRing must have been called on the pipe.
+ *
+ * Input:           pipe        Uses the TRANSFER_FLAGS (see USBCommon.h)
+ *                              format to identify the endpoint and direction
+ *                              making up the pipe.
+ *
+ *                  ping_pong   The descriptor to arm: 0=even/1=odd
+ *
+ *                  buffer      Buffer for the packet.  It must be at least
+ *                              the size given to USBHALStartRing.
+ *
+ * Output:          None
+ *
+ * Returns:         TRUE if successful, FALSE if the descriptor is still 
+ *                  owned by the HW.
+ *
+ * Side Effects:    The descriptor has been passed to the HW.
+ *
+ * Overview:        This routine hands one descriptor of a ring pipe to the
+ *                  HW.  Each descriptor sees every second packet, so it is
+ *                  re-armed with the same data toggle it last carried.
+ *****************************************************************************/
+
+PUBLIC BOOL USBHALArmRingPacket( TRANSFER_FLAGS pipe, BYTE ping_pong, void *buffer )
+{
+    PUSB_HAL_PIPE   p_Pipe;     // Pointer to pipe data
+    pBUF_DESC       desc;
+
+
+    // Range check the BDT index
+    #ifdef USB_SAFE_MODE
+    if (pipe.field.ep_num > USB_DEV_HIGHEST_EP_NUMBER) {
+        return FALSE;
+    }
+    #endif
+
+    // Find the pipe data.
+    p_Pipe = FindPipe(pipe.field.ep_num, pipe.field.direction);
+
+    if (!p_Pipe->flags.field.ring) {
+        return FALSE;
+    }
+
+    desc = FindDescriptor(pipe.field.ep_num, pipe.field.direction, ping_pong & 1);
+    if (desc->setup.Val & USBHAL_DESC_UOWN) {
+        return FALSE; // We don't own the descriptor right now, don't touch it!
+    }
+
+    // Set the buffer address and size.
+    desc->addr        = (DATA_PTR_SIZE)KVA_TO_PA((UINT32)buffer);
+    desc->byte_cnt.BC = p_Pipe->size;
+
+    // Keep the data toggle & hand off the descriptor (& buffer) to the HW.
+    desc->setup.Val = USBHAL_DESC_UOWN|USBHAL_DESC_DTS|(desc->setup.Val & USBHAL_DESC_DATA1);
+
+    return TRUE;
+
+}   // USBHALArmRingPacket
+
+
 /*************************************************************************
  * Function:        USBHALSetEpConfiguration
  *
@@ -1544,6 +1792,12 @@ PUBLIC BOOL USBHALInitialize ( unsigned long flags )
         //IPC11CLR    = 0x0000FF00;
         IPC11SET    = 0x00001000;
         IEC1SET     = 0x02000000;
+    #elif defined(USB_DEV_EVENT_SIGNALED)
+        // Raise the module interrupt for bus activity; the application
+        // enables it in the interrupt controller.
+        U1IE    = STATUS_MASK;
+        U1EIE   = ERROR_MASK;
+        U1OTGIE = 0;
     #else
         // Disable  interrupts.
         U1IE    = 0;
@@ -1569,8 +1823,11 @@ PUBLIC BOOL USBHALInitialize ( unsigned long flags )
      */
     void __ISR(_USB1_VECTOR, ipl4) _USB1Interrupt(void)
     {
+        unsigned int start = ReadCoreTimer();
+
         IFS1CLR = 0x02000000; // USBIF
         USBHALHandleBusEvent();
+        TLM_recordIsr(TLM_ISR_USB, start);
     }
 
 #endif // Interrupt-Driven Mode
@@ -227,7 +227,61 @@ unsigned long USBHALGetLastError( void );
 
 /*************************************************************************
     Function:
-        void USBHALHandleBusEvent ( void )
+        void USBHALGetFrameTime( UINT16 *frame, UINT32 *time, UINT32 *count )
+        
+    Description:
+        This routine provides the frame number of the most recent
+        Start-Of-Frame token and the core timer count it was seen at.
+        
+    Precondition:
+        USBInitialize must have been called to initialize the
+        USB SW stack.
+        
+    Parameters:
+        frame - 11-bit USB frame number
+        time  - Core timer count when the SOF was handled
+        count - Number of SOFs handled since the HAL was initialized
+        
+    Return Values:
+        None
+        
+    Remarks:
+        Only available when USB_DEVICE_ENABLE_SOF_EVENTS is defined.
+                  
+ *************************************************************************/
+
+void USBHALGetFrameTime( UINT16 *frame, UINT32 *time, UINT32 *count );
+
+
+/*************************************************************************
+    Function:
+        UINT32 USBHALGetRamUse( void )
+        
+    Description:
+        This routine provides the number of bytes of RAM used by the 
+        buffer descriptor table and the HAL's data.
+        
+    Precondition:
+        None
+        
+    Parameters:
+        None
+        
+    Return Values:
+        Bytes of RAM
+        
+    Remarks:
+        The alignment gap in front of the buffer descriptor table is
+        not included.
+                  
+ *************************************************************************/
+
+UINT32 USBHALGetRamUse( void );
+
+
+/*************************************************************************
+    Function:
+        BOOL USBHALHandleBusEvent ( void )
         
     Description:
         This routine checks the USB for any events that may
@@ -243,7 +297,7 @@ unsigned long USBHALGetLastError( void );
         None
         
     Return Values:
-        None
+        TRUE if there was an event to handle
         
     Side Effects:
         Depend on the event that may have occured.
@@ -253,7 +307,7 @@ unsigned long USBHALGetLastError( void );
               
  *************************************************************************/
 
-void USBHALHandleBusEvent ( void );
+BOOL USBHALHandleBusEvent ( void );
 
 
 /*************************************************************************
@@ -420,6 +474,75 @@ BOOL USBHALEndpointHasBeenStalled ( TRANSFER_FLAGS endpoint );
 BOOL USBHALFlushPipe( TRANSFER_FLAGS pipe );
 
 
+/******************************************************************************
+    Function:
+        BOOL USBHALStartRing( TRANSFER_FLAGS pipe, unsigned int size, 
+                              BYTE *ping_pong )
+        
+    Description:
+        This routine switches a pipe into ring mode, where the even and odd
+        descriptors are armed independently and every packet is reported
+        by its own EVENT_TRANSFER event.
+        
+    Preconditions:
+        USBHALInitialize must have been called to initialize the
+        USB HAL and the endpoint must have been configured.
+
+    Parameters:
+        pipe -      Uses the TRANSFER_FLAGS (see USBCommon.h) format to
+                    identify the endpoint and direction making up the
+                    pipe.
+        size -      Size of each buffer armed on the pipe.
+        ping_pong - Receives the descriptor (0=even/1=odd) that will
+                    get the first packet.
+
+    Return Values:
+        TRUE if successful, FALSE if the pipe is busy.
+
+    Side Effects:
+        None of the descriptors is armed yet.
+
+    Remarks:
+        Packets complete alternately on the even and odd descriptors.
+        The pipe stays in ring mode until it is flushed or the HAL is
+        reinitialized.
+ *****************************************************************************/
+
+BOOL USBHALStartRing( TRANSFER_FLAGS pipe, unsigned int size, BYTE *ping_pong );
+
+
+/******************************************************************************
+    Function:
+        BOOL USBHALArmRingPacket( TRANSFER_FLAGS pipe, BYTE ping_pong, 
+                                  void *buffer )
+        
+    Description:
+        This routine hands one descriptor of a ring pipe to the HW.
+        
+    Preconditions:
+        USBHALStartRing must have been called on the pipe.
+
+    Parameters:
+        pipe -      Uses the TRANSFER_FLAGS (see USBCommon.h) format to
+                    identify the endpoint and direction making up the
+                    pipe.
+        ping_pong - The descriptor to arm: 0=even/1=odd
+        buffer -    Buffer for the packet, at least the size given to
+                    USBHALStartRing.
+
+    Return Values:
+        TRUE if successful, FALSE if the HW still owns the descriptor.
+
+    Side Effects:
+        None
+
+    Remarks:
+        None
+ *****************************************************************************/
+
+BOOL USBHALArmRingPacket( TRANSFER_FLAGS pipe, BYTE ping_pong, void *buffer );
+
+
 /**************************************************************************
     Function:
         USBHALTransferData
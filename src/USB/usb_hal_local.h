@@ -542,7 +542,8 @@ typedef union
         BYTE data_toggle: 1; // Data toggle: 0=DATA0/1=DATA1
         BYTE ping_pong:   1; // Current ping pong: 0=even/1=odd
         BYTE send_0_pkt:  1; // Flag indicating when to send a zero-sized packet
-        BYTE reserved:    4; // Reserved
+        BYTE ring:        1; // Packets complete one at a time (see USBHALStartRing)
+        BYTE reserved:    3; // Reserved
 
     }field;
 
@@ -673,7 +674,11 @@ typedef union
 #define UEIR_DMA_ERR         0x00000020
 #define UEIR_BTS_ERR         0x00000080
 
-#define STATUS_MASK (UIR_USB_RST|UIR_UERR|UIR_TOK_DNE|UIR_UIDLE|UIR_RESUME|UIR_STALL)
+#if defined(USB_DEVICE_ENABLE_SOF_EVENTS)
+    #define STATUS_MASK (UIR_USB_RST|UIR_UERR|UIR_SOF_TOK|UIR_TOK_DNE|UIR_UIDLE|UIR_RESUME|UIR_STALL)
+#else
+    #define STATUS_MASK (UIR_USB_RST|UIR_UERR|UIR_TOK_DNE|UIR_UIDLE|UIR_RESUME|UIR_STALL)
+#endif
 
 
 /* USB_HAL_DATA
@@ -695,6 +700,11 @@ typedef union
         volatile BOOL   attaching;
         volatile unsigned int resume_counter;       // Resume signaling timer counter
         volatile BOOL   resuming;
+        #if defined(USB_DEVICE_ENABLE_SOF_EVENTS)
+        UINT16          sof_frame;               // Frame number of the last SOF
+        UINT32          sof_time;                // Core timer count at the last SOF
+        UINT32          sof_count;               // Number of SOFs seen
+        #endif
     } USB_HAL_DATA, *PUSB_HAL_DATA;
     
     
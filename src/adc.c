@@ -66,9 +66,9 @@ void ADC_init(void) {
     EnableADC10();                             
 
     ADC_led_pin = 0x0100;
-    
-    // wait for the first conversion to complete 
-    while ( ! mAD1GetIntFlag() );
+
+    // the first conversion is handled by the ISR like any other, so 
+    // there is nothing to wait for here
 }
 
 void ADC_storeMostRecent() {
@@ -97,27 +97,18 @@ void ADC_storeMostRecent() {
     // combine the three 10 bit results into one 32 bit dword
     data = (x1 << 2) | (x2 << 12) | (x3 << 22);
 
-    // write data to the buffer
-    *(unsigned int*)&(SMP_BUFFER[SMP_PACKET_OFFSET]) = data;
-    SMP_PACKET_OFFSET += 4;
-
-    if ( SMP_PACKET_OFFSET >= (SMP_SAMPLE_BUFFER_NUM+1)*SMP_BUFFER_SIZE) {
-        // A 1k block has been filled
-        
-        // mark it as ready to send
-        SMP_BUFFER_STATE[SMP_SAMPLE_BUFFER_NUM] |= SMP_BUF_RTS;
-        
-        // go on to the next block
-        SMP_SAMPLE_BUFFER_NUM = (SMP_SAMPLE_BUFFER_NUM + 1) % SMP_NUM_BUFFERS;
-        SMP_PACKET_OFFSET = (SMP_SAMPLE_BUFFER_NUM * SMP_BUFFER_SIZE);
-
-        // mark this buffer with a sample packet id
-        // this number increments so that the PC knows 
-        // if it is missing packets
-        SMP_PACKET_ID++;
-        *(unsigned int*)&(SMP_BUFFER[SMP_PACKET_OFFSET]) = SMP_PACKET_ID;
-        SMP_PACKET_OFFSET += 4;
+    // apply a scheduled MDAC change and mark it in the stream
+    if ( SMP_MDAC_PENDING && (int)(SMP_SAMPLE_COUNT - SMP_MDAC_AT) >= 0 ) {
+        SMP_MDAC_PENDING = 0;
+        MDAC_value = SMP_MDAC_NEXT;
+        MDAC_send(0x1000 | MDAC_value);
+        TRC_record(TRC_MDAC_WRITE, 1, MDAC_value);
+        SMP_putWord(SMP_MARKER_MDAC | (MDAC_value << 2));
+        SMP_putWord(SMP_SAMPLE_COUNT);
     }
+
+    SMP_putWord(data);
+    SMP_SAMPLE_COUNT++;
 }
 
 /* ADC ISR */
@@ -128,6 +119,9 @@ void __ISR(_ADC_VECTOR, ipl7) ADCHandler(void) {
      * This is painfully simple. It clears the interrupt flag then calls
      * ADC_storeMostRecent to handle the new data
      */
+    unsigned int start = ReadCoreTimer();
+
+    TLM_recordAdcEntry(start);
      
     // clear the interrupt flag                         
     IFS1bits.AD1IF = 0;
@@ -138,9 +132,16 @@ void __ISR(_ADC_VECTOR, ipl7) ADCHandler(void) {
     if ( SMP_MODE == SAMPLING ) {
         ADC_storeMostRecent();
     }
+
+    if ( WAVE_playing ) {
+        WAVE_step();
+    }
     
     // pull RB8 back down
     LATB = LATB & ~ADC_led_pin;
 
+    TLM_recordAdcIsr(ReadCoreTimer() - start);
+    TLM_recordIsr(TLM_ISR_ADC, start);
+
 }
 
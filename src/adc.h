@@ -9,6 +9,12 @@
 #include <plib.h>
 #include "sampling.h"
 #include "globals.h"
+#include "telemetry.h"
+#include "wave.h"
+
+/* PB clocks per scan: 3 inputs at 10 TAD sampling and 12 TAD 
+ * conversion each, with TAD = 2*(3+1) PB clocks (see AD1CON3) */
+#define ADC_SCAN_PBCLKS (3 * (10 + 12) * 2 * (3 + 1))
 
 void ADC_init(void);
 void ADC_read(void);
@@ -0,0 +1,50 @@
+/**
+ * \file clock.c
+ * \brief 64 bit monotonic clock
+ *
+ * The core timer counts at SYS_CLOCK/2 (50 ns) and wraps every 214 s. 
+ * CLK_now extends it to 63 bits, which is good for thousands of years.
+ *
+ * CLK_high holds the upper 31 bits of the count in its low bits, and in
+ * its top bit a copy of the core timer's top bit as of when it was 
+ * stored. A reader whose core timer read has a different top bit knows
+ * the timer has moved on by half a period since, and works out the new 
+ * CLK_high itself: flip the top bit, and carry into the upper bits if
+ * the timer wrapped. Every reader that sees the same half works out the
+ * same value, so readers can update CLK_high in any order from any 
+ * context, with no lock and no interrupts held off.
+ *
+ * This only holds if CLK_now runs at least once every half period 
+ * (107 s), which the 1 ms timer2 tick takes care of (see CLK_tick).
+ *
+ * The tick also counts ms for CLK_ms, so timestamps taken in ISRs need
+ * no 64 bit division.
+ */
+
+#include "clock.h"
+
+volatile unsigned int CLK_high;
+
+// Clock when main() started
+unsigned long long CLK_boot;
+
+// ms since timer2 started
+volatile unsigned int CLK_msec;
+
+void CLK_init(void) {
+    /**
+     * Start the clock from the core timer's current count
+     *
+     * Called first thing in main(), so the boot times count from there.
+     */
+    CLK_high = ReadCoreTimer() & 0x80000000;
+    CLK_boot = CLK_now();
+    CLK_msec = 0;
+}
+
+unsigned int CLK_usSinceBoot(void) {
+    /**
+     * Get the us since main() started, up to 71 minutes
+     */
+    return (unsigned int)((CLK_now() - CLK_boot) / (CLK_TICKS_PER_SEC/1000000));
+}
@@ -0,0 +1,55 @@
+/**
+ * \file clock.h
+ * \brief Header file for clock.c
+ */
+
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include <plib.h>
+#include "globals.h"
+
+/* Clock ticks (core timer, SYS_CLOCK/2) per second and per ms */
+#define CLK_TICKS_PER_SEC (GetSystemClock()/2)
+#define CLK_TICKS_PER_MS (GetSystemClock()/2000)
+
+extern volatile unsigned int CLK_high;
+extern unsigned long long CLK_boot;
+extern volatile unsigned int CLK_msec;
+
+void CLK_init(void);
+unsigned int CLK_usSinceBoot(void);
+
+inline unsigned long long
+CLK_now(void) {
+    // 63 bit core timer count, see clock.c; safe from any context
+    unsigned int high;
+    unsigned int low;
+
+    high = CLK_high;
+    __asm__ __volatile__("" : : : "memory");
+    low = ReadCoreTimer();
+    if((int)(high ^ low) < 0) {
+        // the count has crossed a half since CLK_high was stored
+        high = (high ^ 0x80000000) + (high >> 31);
+        CLK_high = high;
+    }
+    return ((unsigned long long)(high & 0x7FFFFFFF) << 32) | low;
+}
+
+inline unsigned int
+CLK_ms(void) {
+    // ms counted by the timer2 tick, modulo 2^32; for timestamps that are
+    // compared by difference. Cheap enough for any ISR.
+    return CLK_msec;
+}
+
+inline void
+CLK_tick(void) {
+    // called from the 1 ms timer2 ISR; also keeps the overflow extension
+    // current (see clock.c)
+    CLK_msec++;
+    CLK_now();
+}
+
+#endif
@@ -0,0 +1,498 @@
+/**
+ * \file command.c
+ * \brief Command registry shared by the USB and debug UART front ends
+ *
+ * Every command is listed once in CMD_table with its USB opcode, its 
+ * text name and the arguments it takes. The USB front end looks commands
+ * up by opcode through a 256 entry index, the UART front end by name 
+ * with a binary search over a sorted index, so neither scans the table.
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include "command.h"
+#include "led.h"
+#include "chaos.h"
+#include "adc.h"
+#include "encoder.h"
+#include "wave.h"
+#include "uart_stream.h"
+#include "debug_uart.h"
+#include "profile.h"
+#include "trace.h"
+#include "swtimer.h"
+
+static int CMD_doPing(struct CMD_args* args);
+static int CMD_doStatus(struct CMD_args* args);
+static int CMD_doBulkTest(struct CMD_args* args);
+static int CMD_doLedTest(struct CMD_args* args);
+static int CMD_doAck(struct CMD_args* args);
+static int CMD_doStartSample(struct CMD_args* args);
+static int CMD_doEndSample(struct CMD_args* args);
+static int CMD_doGetData(struct CMD_args* args);
+static int CMD_doSetMdac(struct CMD_args* args);
+static int CMD_doGetVersion(struct CMD_args* args);
+static int CMD_doGetFrameTime(struct CMD_args* args);
+static int CMD_doUpload(struct CMD_args* args);
+static int CMD_doWaveStart(struct CMD_args* args);
+static int CMD_doWaveStop(struct CMD_args* args);
+static int CMD_doScheduleMdac(struct CMD_args* args);
+static int CMD_doUartStream(struct CMD_args* args);
+static int CMD_doIsrStats(struct CMD_args* args);
+static int CMD_doProfile(struct CMD_args* args);
+static int CMD_doProfileDump(struct CMD_args* args);
+static int CMD_doTrace(struct CMD_args* args);
+static int CMD_doTraceDump(struct CMD_args* args);
+static int CMD_doMemory(struct CMD_args* args);
+static int CMD_doPrintMemory(struct CMD_args* args);
+static int CMD_doHelp(struct CMD_args* args);
+static int CMD_doReset(struct CMD_args* args);
+static int CMD_doChaosOn(struct CMD_args* args);
+static int CMD_doChaosOff(struct CMD_args* args);
+static int CMD_doEncoderOn(struct CMD_args* args);
+static int CMD_doEncoderOff(struct CMD_args* args);
+static int CMD_doAdcOn(struct CMD_args* args);
+static int CMD_doAdcOff(struct CMD_args* args);
+static int CMD_doSamplePin(struct CMD_args* args);
+
+static const struct CMD_entry CMD_table[] = {
+    { CMD_ping, 0, NULL, NULL, CMD_doPing },
+    { CMD_status, 0, NULL, NULL, CMD_doStatus },
+    { CMD_bulk_test, CMD_ARG_LENGTH, NULL, NULL, CMD_doBulkTest },
+    { CMD_LED_test, 0, "ledtest", "Flashes the LEDs.", CMD_doLedTest },
+    { CMD_reset, 0, NULL, NULL, CMD_doAck },
+    { CMD_start_sample, CMD_ARG_VALUE, "start", "Starts sampling, at MDAC value # if given.", CMD_doStartSample },
+    { CMD_end_sample, 0, "end", "Ends sampling.", CMD_doEndSample },
+    { CMD_get_data, 0, NULL, NULL, CMD_doGetData },
+    { CMD_set_mdac, CMD_ARG_VALUE, "mdac", "Changes the value of the mdac to a specified number.", CMD_doSetMdac },
+    { CMD_get_version, 0, NULL, NULL, CMD_doGetVersion },
+    { CMD_get_frame_time, 0, NULL, NULL, CMD_doGetFrameTime },
+    { CMD_upload, CMD_ARG_LENGTH, NULL, NULL, CMD_doUpload },
+    { CMD_wave_start, 0, "wavestart", "Plays the uploaded waveform table.", CMD_doWaveStart },
+    { CMD_wave_stop, 0, "wavestop", "Stops the waveform.", CMD_doWaveStop },
+    { CMD_schedule_mdac, CMD_ARG_VALUE | CMD_ARG_INDEX, "schedule", "Sets the mdac to # at sample #.", CMD_doScheduleMdac },
+    { CMD_uart_stream, CMD_ARG_LENGTH, "stream", "1 streams samples over this UART (changes the baud rate), 0 stops.", CMD_doUartStream },
+    { CMD_isr_stats, CMD_ARG_VALUE | CMD_ARG_LENGTH, NULL, NULL, CMD_doIsrStats },
+    { CMD_profile, CMD_ARG_LENGTH, "profile", "Samples the program counter # times a second, 0 stops.", CMD_doProfile },
+    { CMD_profile_dump, 0, NULL, NULL, CMD_doProfileDump },
+    { CMD_trace, CMD_ARG_LENGTH, "trace", "1 clears and restarts the event trace, 0 freezes it.", CMD_doTrace },
+    { CMD_trace_dump, 0, NULL, NULL, CMD_doTraceDump },
+    { CMD_memory, 0, NULL, NULL, CMD_doMemory },
+    { CMD_none, 0, "help", "Prints this message.", CMD_doHelp },
+    { CMD_none, 0, "reset", "Resets the Chaos Unit.", CMD_doReset },
+    { CMD_none, 0, "chaoson", "Powers on the Chaos circuitry.", CMD_doChaosOn },
+    { CMD_none, 0, "chaosoff", "Powers down the Chaos circuitry.", CMD_doChaosOff },
+    { CMD_none, 0, "encen", "Enables the encoder.", CMD_doEncoderOn },
+    { CMD_none, 0, "encdis", "Disables the encoder.", CMD_doEncoderOff },
+    { CMD_none, 0, "adcon", "Enables the ADC.", CMD_doAdcOn },
+    { CMD_none, 0, "adcoff", "Disables the ADC.", CMD_doAdcOff },
+    { CMD_none, 0, "mem", "Prints the stack high-water mark and RAM use.", CMD_doPrintMemory },
+    { CMD_none, 0, "samplepin", "Toggles the sample indicator pin.", CMD_doSamplePin }
+};
+
+#define CMD_COUNT (sizeof(CMD_table)/sizeof(CMD_table[0]))
+
+// Table position + 1 for each opcode, 0 if there is no such command
+static unsigned char CMD_by_opcode[256];
+// Table positions of the named commands, sorted by name
+static unsigned char CMD_by_name[CMD_COUNT];
+static int CMD_names;
+
+// The help is printed a few lines at a time (see CMD_printHelp)
+#define CMD_HELP_PERIOD 10      // ms
+#define CMD_HELP_LINE_MAX 96    // longest help line, with the tabs
+
+static struct SWT_timer CMD_help_timer;
+static int CMD_help_line;
+
+static void CMD_printHelpLines(void* arg);
+
+void CMD_init(void) {
+    /**
+     * Build the opcode and name indexes
+     */
+    int i;
+    int j;
+    unsigned char entry;
+
+    memset(CMD_by_opcode, 0, sizeof(CMD_by_opcode));
+    CMD_names = 0;
+
+    for(i = 0; i < CMD_COUNT; i++) {
+        if(CMD_table[i].opcode != CMD_none) {
+            CMD_by_opcode[CMD_table[i].opcode] = i + 1;
+        }
+        if(CMD_table[i].name != NULL) {
+            // insertion sort, the table is small
+            entry = i;
+            for(j = CMD_names; j > 0 && strcmp(CMD_table[CMD_by_name[j-1]].name, CMD_table[entry].name) > 0; j--) {
+                CMD_by_name[j] = CMD_by_name[j-1];
+            }
+            CMD_by_name[j] = entry;
+            CMD_names++;
+        }
+    }
+
+    SWT_setup(&CMD_help_timer, CMD_printHelpLines, NULL);
+}
+
+const struct CMD_entry* CMD_findOpcode(int opcode) {
+    /**
+     * Find a command by its USB opcode
+     */
+    if(opcode < 0 || opcode > 255 || CMD_by_opcode[opcode] == 0) {
+        return NULL;
+    }
+    return &CMD_table[CMD_by_opcode[opcode] - 1];
+}
+
+const struct CMD_entry* CMD_findName(const char* name) {
+    /**
+     * Find a command by its text name
+     */
+    int low = 0;
+    int high = CMD_names - 1;
+    int middle;
+    int order;
+
+    while(low <= high) {
+        middle = (low + high) / 2;
+        order = strcmp(name, CMD_table[CMD_by_name[middle]].name);
+        if(order == 0) {
+            return &CMD_table[CMD_by_name[middle]];
+        } else if(order < 0) {
+            high = middle - 1;
+        } else {
+            low = middle + 1;
+        }
+    }
+    return NULL;
+}
+
+void CMD_runUSB(struct USB_command_packet* packet) {
+    /**
+     * Run a command received over USB
+     *
+     * Unknown opcodes get no reply, as before.
+     */
+    const struct CMD_entry* entry;
+    struct CMD_args args;
+
+    entry = CMD_findOpcode(packet->command);
+    if(entry == NULL) {
+        return;
+    }
+
+    args.value = packet->mdac_value;
+    args.index = USB_COMMAND_INDEX(packet);
+    args.length = packet->length;
+
+    switch(entry->handler(&args)) {
+        case CMD_OK:
+            USB_sendAck();
+            break;
+        case CMD_FAIL:
+            USB_sendNak();
+            break;
+        default:
+            break;
+    }
+}
+
+void CMD_runText(char* line) {
+    /**
+     * Run a command line typed on the debug UART
+     *
+     * The line is a name followed by the numbers the command takes. 
+     * Numbers that are left out are passed as -1.
+     */
+    const struct CMD_entry* entry;
+    struct CMD_args args;
+    char* rest;
+
+    rest = strchr(line, ' ');
+    if(rest != NULL) {
+        *rest++ = '\0';
+    } else {
+        rest = line + strlen(line);
+    }
+    if(*line == '\0') {
+        return;
+    }
+
+    entry = CMD_findName(line);
+    if(entry == NULL) {
+        DBG_WriteString("Unknown command, try help.\r\n");
+        return;
+    }
+
+    args.value = -1;
+    args.index = -1;
+    args.length = -1;
+    if(entry->args & CMD_ARG_VALUE) {
+        args.value = (*rest != '\0') ? strtol(rest, &rest, 0) : -1;
+    }
+    if(entry->args & CMD_ARG_INDEX) {
+        args.index = (*rest != '\0') ? strtoul(rest, &rest, 0) : -1;
+    }
+    if(entry->args & CMD_ARG_LENGTH) {
+        args.length = (*rest != '\0') ? strtoul(rest, &rest, 0) : -1;
+    }
+
+    if(entry->handler(&args) == CMD_FAIL) {
+        DBG_WriteString("Command failed.\r\n");
+    }
+}
+
+void CMD_printHelp(void) {
+    /**
+     * Print the text commands, in name order
+     *
+     * The help is nearly as long as the debug UART's transmit ring, so it
+     * is queued a few lines at a time as the ring drains, from a software
+     * timer. This returns straight away.
+     */
+    CMD_help_line = -1;
+    SWT_start(&CMD_help_timer, 1, CMD_HELP_PERIOD);
+}
+
+static void CMD_printHelpLines(void* arg) {
+    /**
+     * Queue as many help lines as the transmit ring has room for
+     *
+     * Line -1 is the title.
+     */
+    const struct CMD_entry* entry;
+
+    while(DBG_txFree() >= CMD_HELP_LINE_MAX) {
+        if(CMD_help_line >= CMD_names) {
+            SWT_stop(&CMD_help_timer);
+            return;
+        }
+        if(CMD_help_line < 0) {
+            DBG_WriteString("\r\n*********Chaos Unit Debug UART Help***************\r\n");
+        } else {
+            entry = &CMD_table[CMD_by_name[CMD_help_line]];
+            DBG_WriteString("\t");
+            DBG_WriteString((char*)entry->name);
+            DBG_WriteString(strlen(entry->name) < 8 ? (entry->args ? " #\t\t-" : "\t\t-") : "\t-");
+            DBG_WriteString((char*)entry->help);
+            DBG_WriteString("\r\n");
+        }
+        CMD_help_line++;
+    }
+}
+
+/* Handlers */
+
+static int CMD_doPing(struct CMD_args* args) {
+    USB_sendPingReply();
+    return CMD_REPLIED;
+}
+
+static int CMD_doStatus(struct CMD_args* args) {
+    USB_sendStatus();
+    return CMD_REPLIED;
+}
+
+static int CMD_doBulkTest(struct CMD_args* args) {
+    USB_startBulkTest();
+    return CMD_REPLIED;
+}
+
+static int CMD_doLedTest(struct CMD_args* args) {
+    LED_test();
+    return CMD_OK;
+}
+
+static int CMD_doAck(struct CMD_args* args) {
+    return CMD_OK;
+}
+
+static int CMD_doStartSample(struct CMD_args* args) {
+    SMP_start(args->value);
+    return CMD_OK;
+}
+
+static int CMD_doEndSample(struct CMD_args* args) {
+    SMP_end();
+    return CMD_OK;
+}
+
+static int CMD_doGetData(struct CMD_args* args) {
+    if(!SMP_requestData()) {
+        return CMD_FAIL;
+    }
+    return CMD_REPLIED;
+}
+
+static int CMD_doSetMdac(struct CMD_args* args) {
+    if(args->value < 0) {
+        return CMD_FAIL;
+    }
+    MDAC_setValue(args->value);
+    return CMD_OK;
+}
+
+static int CMD_doGetVersion(struct CMD_args* args) {
+    USB_sendVersion();
+    return CMD_REPLIED;
+}
+
+static int CMD_doGetFrameTime(struct CMD_args* args) {
+    USB_sendFrameTime();
+    return CMD_REPLIED;
+}
+
+static int CMD_doUpload(struct CMD_args* args) {
+    // a playing waveform reads its codes from the upload buffer
+    WAVE_stop();
+    USB_startUpload();
+    return CMD_REPLIED;
+}
+
+static int CMD_doWaveStart(struct CMD_args* args) {
+    if(!WAVE_start((struct WAVE_table*)USB_upload_buffer, USB_UPLOAD_SIZE)) {
+        return CMD_FAIL;
+    }
+    return CMD_OK;
+}
+
+static int CMD_doWaveStop(struct CMD_args* args) {
+    WAVE_stop();
+    return CMD_OK;
+}
+
+static int CMD_doScheduleMdac(struct CMD_args* args) {
+    if(args->value < 0 || !SMP_scheduleMdac(args->value, args->index)) {
+        return CMD_FAIL;
+    }
+    return CMD_OK;
+}
+
+static int CMD_doUartStream(struct CMD_args* args) {
+    if(args->length == 0) {
+        UST_stop();
+    } else {
+        UST_start();
+    }
+    return CMD_OK;
+}
+
+static int CMD_doIsrStats(struct CMD_args* args) {
+    if(args->value < 0 || args->value >= TLM_ISR_COUNT) {
+        return CMD_FAIL;
+    }
+    // only clear the histograms once they have actually been sent
+    if(USB_sendIsrStats(args->value) && args->length != 0) {
+        TLM_resetIsrStats();
+    }
+    return CMD_REPLIED;
+}
+
+static int CMD_doProfile(struct CMD_args* args) {
+    if(args->length == 0) {
+        PROF_stop();
+        return CMD_OK;
+    }
+    if(!PROF_start(args->length)) {
+        return CMD_FAIL;
+    }
+    return CMD_OK;
+}
+
+static int CMD_doProfileDump(struct CMD_args* args) {
+    USB_sendRaw((byte*)&PROF_data, sizeof(PROF_data));
+    return CMD_REPLIED;
+}
+
+static int CMD_doTrace(struct CMD_args* args) {
+    if(args->length == 0) {
+        TRC_stop();
+    } else {
+        TRC_init();
+    }
+    return CMD_OK;
+}
+
+static int CMD_doTraceDump(struct CMD_args* args) {
+    USB_sendRaw((byte*)&TRC_ring, sizeof(TRC_ring));
+    return CMD_REPLIED;
+}
+
+static int CMD_doMemory(struct CMD_args* args) {
+    USB_sendMemory();
+    return CMD_REPLIED;
+}
+
+static int CMD_doPrintMemory(struct CMD_args* args) {
+    struct USB_memory_packet memory;
+
+    USB_fillMemory(&memory);
+    DBG_WriteString("RAM: ");
+    DBG_WriteInt(memory.ram_size);
+    DBG_WriteString("static: ");
+    DBG_WriteInt(memory.static_size);
+    DBG_WriteString("  samples: ");
+    DBG_WriteInt(memory.sample_buffers);
+    DBG_WriteString("  upload: ");
+    DBG_WriteInt(memory.upload_buffer);
+    DBG_WriteString("  usb: ");
+    DBG_WriteInt(memory.usb);
+    DBG_WriteString("  diagnostics: ");
+    DBG_WriteInt(memory.diagnostics);
+    DBG_WriteString("  other: ");
+    DBG_WriteInt(memory.other);
+    DBG_WriteString("heap: ");
+    DBG_WriteInt(memory.heap_size);
+    DBG_WriteString("stack: ");
+    DBG_WriteInt(memory.stack_size);
+    DBG_WriteString("stack used: ");
+    DBG_WriteInt(memory.stack_used);
+    return CMD_OK;
+}
+
+static int CMD_doHelp(struct CMD_args* args) {
+    CMD_printHelp();
+    return CMD_OK;
+}
+
+static int CMD_doReset(struct CMD_args* args) {
+    SoftReset();
+    return CMD_OK;
+}
+
+static int CMD_doChaosOn(struct CMD_args* args) {
+    CHAOS_turnOn();
+    return CMD_OK;
+}
+
+static int CMD_doChaosOff(struct CMD_args* args) {
+    CHAOS_turnOff();
+    return CMD_OK;
+}
+
+static int CMD_doEncoderOn(struct CMD_args* args) {
+    ENC_intEnable();
+    return CMD_OK;
+}
+
+static int CMD_doEncoderOff(struct CMD_args* args) {
+    ENC_intDisable();
+    return CMD_OK;
+}
+
+static int CMD_doAdcOn(struct CMD_args* args) {
+    ADC_init();
+    return CMD_OK;
+}
+
+static int CMD_doAdcOff(struct CMD_args* args) {
+    CloseADC10();
+    return CMD_OK;
+}
+
+static int CMD_doSamplePin(struct CMD_args* args) {
+    ADC_led_pin ^= 0x0100;
+    return CMD_OK;
+}
@@ -0,0 +1,48 @@
+/**
+ * \file command.h
+ * \brief Header file for command.c
+ */
+
+#ifndef COMMAND_H
+#define COMMAND_H
+
+#include <plib.h>
+#include "globals.h"
+#include "USB/usb.h"
+
+/* Argument descriptors (bits, filled in this order from text) */
+#define CMD_ARG_VALUE 0x01      // USB: mdac_value
+#define CMD_ARG_INDEX 0x02      // USB: (chunk << 16) | length
+#define CMD_ARG_LENGTH 0x04     // USB: length
+
+/* Handler results */
+#define CMD_OK 0                // acknowledge
+#define CMD_FAIL 1              // negative acknowledge
+#define CMD_REPLIED 2           // the handler sent its own reply
+
+struct CMD_args {
+    int value;
+    unsigned int index;
+    unsigned int length;
+};
+
+struct CMD_entry {
+    /// USB opcode, CMD_none for text only commands
+    unsigned char opcode;
+    /// CMD_ARG_* bits
+    unsigned char args;
+    /// Text name, NULL for USB only commands
+    const char* name;
+    /// Help line for the text console
+    const char* help;
+    int (*handler)(struct CMD_args* args);
+};
+
+void CMD_init(void);
+const struct CMD_entry* CMD_findOpcode(int opcode);
+const struct CMD_entry* CMD_findName(const char* name);
+void CMD_runUSB(struct USB_command_packet* packet);
+void CMD_runText(char* line);
+void CMD_printHelp(void);
+
+#endif
@@ -5,19 +5,32 @@
 
 #include "debug_uart.h"
 #include <string.h>
-#include <stdlib.h>
-#include "mdac.h"
-#include "led.h"
-#include "chaos.h"
-#include "adc.h"
+#include "event.h"
+#include "uart_stream.h"
+#include "command.h"
+#include "telemetry.h"
 
 #define COMMAND_SIZE 32
+#define TX_BUFFER_SIZE 1024
+
+// ISRs up to this priority may log. DBG_puts holds them off while it 
+// copies, but never the ADC (ipl7), so sample timing isn't disturbed.
+#define DBG_LOG_IPL 6
 const int BAUD_RATE = 115000;
 
+unsigned int DBG_tx_overflows;
+
 static char command[COMMAND_SIZE];
+static char pending[COMMAND_SIZE];
+static volatile int pending_full;
+
+static char tx_buffer[TX_BUFFER_SIZE];
+static volatile int tx_head;
+static volatile int tx_tail;
+static int streaming;
+
+static unsigned int DBG_raiseIpl(void);
 
-static void ProcessCommand(char* str);
-static void PrintHelp();
 
 void DBG_init(void) {
     /**
@@ -27,6 +40,10 @@ void DBG_init(void) {
      * also does nothing if DEBUG is not defined in the header file.
      */
     #ifdef DEBUG
+    tx_head = 0;
+    tx_tail = 0;
+    DBG_tx_overflows = 0;
+
     int pClock = GetPeripheralClock();
     int BAUD_VALUE = ((pClock/16/BAUD_RATE)-1); 
     
@@ -36,79 +53,105 @@ void DBG_init(void) {
     // Enable interrupts
     ConfigIntUART1(UART_INT_PR2 | UART_RX_INT_EN);    
     
-    // Write Startup String
+    // Write Startup String; the help follows as the ring drains
     DBG_WriteString("****************UART 1 Initialized****************\r\n");
-    PrintHelp();
+    CMD_printHelp();
     #endif
 }
 
-static void ProcessCommand(char* str) {
+void DBG_puts(char* str) {
     /**
-     * Process a command on the UART
+     * Queue a string for the debug UART
+     *
+     * This never waits: the string is copied into the transmit ring and
+     * the UART1 TX interrupt sends it. Characters that don't fit are 
+     * dropped and counted in DBG_tx_overflows. The CPU priority is 
+     * raised to DBG_LOG_IPL while copying, so any ISR up to that priority
+     * can log too.
      */
-    if(strncmp(str, "mdac ", 5) == 0) {
-    // Sets the MDAC value to the specified number
-        DBG_WriteString("Setting custom mdac value.\r\n");
-        int newValue = atoi(&str[4]);
-        MDAC_setValue(newValue); // Set MDAC value to 0
-    } else if(strncmp(str, "help", 4) == 0) {
-    // Prints valid commands
-        PrintHelp();
-    } else if(strncmp(str, "reset", 5) == 0) {
-    // Resets the device
-        SoftReset();
-    }  else if(strncmp(str, "ledtest", 7) == 0) {
-    // Run the led test
-        LED_test();
-    } else if(strncmp(str, "chaoson", 7) == 0) {
-    // Turn on the chaos circuit
-        CHAOS_turnOn();
-    } else if(strncmp(str, "chaosoff", 8) == 0) {
-    // Turn off the chaos circuit
-        CHAOS_turnOff();
-    } else if(strncmp(str, "encen", 5) == 0) {
-    // Enable the encoder interrupts
-        ENC_intEnable();
-    } else if(strncmp(str, "encdis", 6) == 0) {
-    // Disable the encoder interrupts
-        ENC_intDisable();
-    } else if(strncmp(str, "ledchaos", 8) == 0) {
-    // Toggles the chaos LED
-        // mChaosLED_Toggle();
-    } else if(strncmp(str, "adcon", 5) == 0) {
-    // Enables the ADC.
-        ADC_init();
-    } else if(strncmp(str, "adcoff", 6) == 0) {
-    // Disables the ADC.
-        CloseADC10();
-    } else if(strncmp(str, "samplepin", 9) == 0) {
-    // Enables/disables the toggling of the sampling indicator pin.
-        ADC_led_pin ^= 0x0100;
+    unsigned int status;
+    int next;
+
+    status = DBG_raiseIpl();
+    if(streaming) {
+        // the sample stream owns the transmitter
+        while(*str++ != '\0') {
+            DBG_tx_overflows++;
+        }
+        _CP0_SET_STATUS(status);
+        return;
+    }
+    while(*str != '\0') {
+        next = (tx_head + 1) % TX_BUFFER_SIZE;
+        if(next == tx_tail) {
+            while(*str++ != '\0') {
+                DBG_tx_overflows++;
+            }
+            break;
+        }
+        tx_buffer[tx_head] = *str++;
+        tx_head = next;
     }
+    mU1TXIntEnable(1);
+    _CP0_SET_STATUS(status);
 }
 
-static void PrintHelp() {
+void DBG_putc(char c) {
     /**
-     * Print the help on the debug commands
+     * Queue a character for the debug UART (see DBG_puts)
      */
-    DBG_WriteString("\r\n*********Chaos Unit Debug UART Help***************\r\n");
-    DBG_WriteString("\thelp\t\t-Prints this message.\r\n");
-    DBG_WriteString("\tmdac #\t\t-Changes the value of the mdac to a specified number.\r\n");
-    DBG_WriteString("\treset\t\t-Resets the Chaos Unit.\r\n");
-    
-    DBG_WriteString("\tchaoson\t\t-Powers on the Chaos circuitry.\r\n");
-    DBG_WriteString("\tchaosoff\t-Powers down the Chaos circuitry.\r\n");
-    
-    DBG_WriteString("\tencen\t\t-Enables the encoder.\r\n");
-    DBG_WriteString("\tencdis\t\t-Disables the encoder.\r\n");
-    
-    DBG_WriteString("\tledchaos\t-Toggles the chaos led.\r\n");
-    DBG_WriteString("\tledtest\t\t-Flashes the LEDs.\r\n");
-    
-    DBG_WriteString("\tadcon\t\t-Enables the ADC.\r\n");
-    DBG_WriteString("\tadcoff\t\t-Disables the ADC.\r\n");
-    
-    DBG_WriteString("\tsamplepin\t-Toggles the sample indicator pin.\r\n");
+    char str[2];
+
+    str[0] = c;
+    str[1] = '\0';
+    DBG_puts(str);
+}
+
+int DBG_txFree(void) {
+    /**
+     * Get the number of characters the transmit ring can take
+     */
+    return (tx_tail - tx_head - 1 + TX_BUFFER_SIZE) % TX_BUFFER_SIZE;
+}
+
+void DBG_setStreaming(int on) {
+    /**
+     * Hand UART1 over to the binary sample stream, or take it back
+     *
+     * While streaming the UART runs at UST_BAUD_RATE, DMA feeds the 
+     * transmitter (see uart_stream.c) and debug output is dropped. 
+     * Commands can still be typed at the new rate.
+     */
+    int pClock = GetPeripheralClock();
+
+    mU1TXIntEnable(0);
+    tx_tail = tx_head;
+    streaming = on;
+
+    if(on) {
+        OpenUART1(UART_EN | UART_BRGH_FOUR, UART_RX_ENABLE | UART_TX_ENABLE, (pClock/4/UST_BAUD_RATE)-1);
+    } else {
+        #ifdef DEBUG
+        OpenUART1(UART_EN, UART_RX_ENABLE | UART_TX_ENABLE, (pClock/16/BAUD_RATE)-1);
+        #else
+        CloseUART1();
+        #endif
+    }
+    ConfigIntUART1(UART_INT_PR2 | UART_RX_INT_EN);
+}
+
+void DBG_processCommand(void) {
+    /**
+     * Run the command line handed over by the UART ISR
+     *
+     * Called from the main loop for an EVT_DBG_COMMAND event, so the 
+     * command and its output don't run at interrupt priority. The ISR 
+     * takes the next line once this one is done.
+     */
+    if(pending_full) {
+        CMD_runText(pending);
+        pending_full = 0;
+    }
 }
 
 // UART 1 interrupt handler
@@ -117,6 +160,8 @@ void __ISR(_UART1_VECTOR, ipl2) IntUart1Handler(void) {
      * Handle UART1 interrupts
      */
     static int count = 0;
+    unsigned int start = ReadCoreTimer();
+
     if(mU1RXGetIntFlag()) {
         //Clear the RX interrupt Flag
         mU1RXClearIntFlag();
@@ -125,17 +170,22 @@ void __ISR(_UART1_VECTOR, ipl2) IntUart1Handler(void) {
         char c = ReadUART1();
         
         // Echo what we just received.
-        putcUART1(c);
+        DBG_putc(c);
         
         // Store character
         if (c == 0x7F || c == 0x08) { // backspace/delete
             count--;
         } else if (c == '\r') {
             command[count] = '\0';
-            ProcessCommand(command);
+            // hand the line to the main loop, unless it is still busy
+            // with the last one
+            if(!pending_full) {
+                strcpy(pending, command);
+                pending_full = 1;
+                EVT_post(EVT_DBG_COMMAND, 0);
+            }
             count = 0;
-            putcUART1('\r');
-            putcUART1('\n');
+            DBG_puts("\r\n");
         } else {
             command[count] = c;
             count++;
@@ -145,7 +195,35 @@ void __ISR(_UART1_VECTOR, ipl2) IntUart1Handler(void) {
         }
     }
     
-    if (mU1TXGetIntFlag()) {
+    if (mU1TXGetIntFlag() && !streaming) {
+        // Top up the TX FIFO from the ring
+        while(tx_tail != tx_head && !U1STAbits.UTXBF) {
+            WriteUART1(tx_buffer[tx_tail]);
+            tx_tail = (tx_tail + 1) % TX_BUFFER_SIZE;
+        }
         mU1TXClearIntFlag();
+
+        // Nothing left to send
+        if(tx_tail == tx_head) {
+            mU1TXIntEnable(0);
+        }
+    }
+
+    TLM_recordIsr(TLM_ISR_UART1, start);
+}
+
+static unsigned int DBG_raiseIpl(void) {
+    /**
+     * Raise the CPU priority to DBG_LOG_IPL, if it is lower
+     *
+     * Returns the old CP0 Status to restore. An interrupt between the 
+     * read and the write puts Status back as it found it, so this needs
+     * no lock.
+     */
+    unsigned int status = _CP0_GET_STATUS();
+
+    if(((status & _CP0_STATUS_IPL_MASK) >> _CP0_STATUS_IPL_POSITION) < DBG_LOG_IPL) {
+        _CP0_SET_STATUS((status & ~_CP0_STATUS_IPL_MASK) | (DBG_LOG_IPL << _CP0_STATUS_IPL_POSITION));
     }
+    return status;
 }
@@ -10,12 +10,19 @@
 #include <GenericTypeDefs.h>
 #include "globals.h"
 
+extern unsigned int DBG_tx_overflows;
+
 void DBG_SendData(char *data);
+void DBG_puts(char* str);
+void DBG_putc(char c);
+int DBG_txFree(void);
+void DBG_processCommand(void);
+void DBG_setStreaming(int on);
 
 inline void
 DBG_WriteString(char *data) {
     #ifdef DEBUG
-        putsUART1(data);
+        DBG_puts(data);
     #endif
 }
 
@@ -24,7 +31,7 @@ DBG_WriteInt(int data) {
     #ifdef DEBUG
         char str[32];
         sprintf(str, "%d\r\n", data);
-        putsUART1(str);
+        DBG_puts(str);
     #endif
 }
 #endif
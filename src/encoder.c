@@ -7,6 +7,9 @@
 #include "local_typedefs.h"
 #include "mdac.h"
 #include "tone.h"
+#include "event.h"
+#include "telemetry.h"
+#include "clock.h"
 // Be sure to change the read bits in the ISR if changing these values
 #define ENCA BIT_13
 #define ENCB BIT_14
@@ -29,6 +32,9 @@
 
 int ENC_elapsed;
 
+// CLK_ms time of the last MDAC step
+static unsigned int ENC_last_step;
+
 static byte lastValue;
 static byte currentValue;
 static byte lastSwitchState;
@@ -43,6 +49,7 @@ void ENC_init() {
      
     //Set up encoder counter
     ENC_elapsed = 0;
+    ENC_last_step = CLK_ms();
     lastSwitchState = UP;
     // set up the on change interupt
 
@@ -83,9 +90,13 @@ void __ISR(_CHANGE_NOTICE_VECTOR, ipl5) ChangeNoticeHandler(void) {
      * the elapsed time between every 4th interrupt, we can adjust the step size based
      * on the duration of the interval.  There are several different implementations shown
      * below that can be toggled on and off with the flags at the top of the function.
+     *
+     * The MDAC and tone work is posted to the main loop (see event.c) so
+     * the SPI writes and debug output don't run at this priority.
      */
     static cwsteps = 0;
     static ccwsteps = 0;
+    unsigned int start = ReadCoreTimer();
     
     // Clear the ISR
     mCNClearIntFlag();
@@ -99,11 +110,11 @@ void __ISR(_CHANGE_NOTICE_VECTOR, ipl5) ChangeNoticeHandler(void) {
     if(switchState != lastSwitchState) {
         if(switchState == UP) {
             if(MDAC_value == 1985) {
-                TONE_playSong(0);
+                EVT_post(EVT_TONE_SONG, 0);
             } else if(MDAC_value == 1977) {
-                TONE_playSong(1);
+                EVT_post(EVT_TONE_SONG, 1);
             }
-            MDAC_resetValue();
+            EVT_post(EVT_MDAC_RESET, 0);
             
         }
         lastSwitchState = switchState;
@@ -114,6 +125,9 @@ void __ISR(_CHANGE_NOTICE_VECTOR, ipl5) ChangeNoticeHandler(void) {
     // Since we are reading bits 13 & 14 we shift to get the grey code
     currentValue = PORTReadBits(SPIN_PORT, ENCA | ENCB) >> 13;
     
+    // ms since the last step; the faster the knob turns, the bigger the step
+    ENC_elapsed = CLK_ms() - ENC_last_step;
+    
     // Calculate what size step to take.
     #ifdef DISCRETE_STEP_CALCULATIONS
         // Discrete
@@ -158,21 +172,21 @@ void __ISR(_CHANGE_NOTICE_VECTOR, ipl5) ChangeNoticeHandler(void) {
         cwsteps++;
         ccwsteps = 0;
         if(cwsteps % 4 == 0) {
-            MDAC_decrement(step);
+            EVT_post(EVT_MDAC_STEP, -step);
             
             char* str[50];
-            ENC_elapsed = 0;
+            ENC_last_step = CLK_ms();
         }
     } else if (ccw[lastValue] == currentValue) {
         ccwsteps++;
         cwsteps = 0;
         if(ccwsteps % 4 == 0) {
-            MDAC_increment(step);
+            EVT_post(EVT_MDAC_STEP, step);
             char* str[50];
-            ENC_elapsed = 0;            
+            ENC_last_step = CLK_ms();            
         }
     }
-    
-    
+
+    TLM_recordIsr(TLM_ISR_CN, start);
 }
 
@@ -0,0 +1,128 @@
+/**
+ * \file event.c
+ * \brief Queue of work posted by ISRs and run from the main loop
+ */
+
+#include "event.h"
+#include "mdac.h"
+#include "tone.h"
+#include "debug_uart.h"
+#include "sched.h"
+
+// One queue per interrupt priority level. A level can not preempt 
+// itself, so each queue has a single producer, and the main loop is 
+// the only consumer. That keeps the queues lock-free.
+static unsigned int EVT_queue[EVT_LEVELS][EVT_QUEUE_SIZE];
+static volatile unsigned char EVT_head[EVT_LEVELS];
+static volatile unsigned char EVT_tail[EVT_LEVELS];
+static unsigned int EVT_dropped[EVT_LEVELS];
+
+static void EVT_handle(int type, int arg);
+
+void EVT_init(void) {
+    /**
+     * Initialize the event queues
+     */
+    int level;
+
+    for(level = 0; level < EVT_LEVELS; level++) {
+        EVT_head[level] = 0;
+        EVT_tail[level] = 0;
+        EVT_dropped[level] = 0;
+    }
+}
+
+int EVT_post(int type, int arg) {
+    /**
+     * Post an event for the main loop
+     *
+     * Safe to call from any ISR or from the main loop. The event goes on
+     * the queue of the caller's priority level, read from the CP0 status
+     * register, so no interrupts are disabled.
+     *
+     * Returns 0 if the queue was full and the event was dropped.
+     */
+    unsigned int level;
+    unsigned char head;
+    unsigned char next;
+
+    level = (_CP0_GET_STATUS() >> 10) & 0x07;
+    head = EVT_head[level];
+    next = (head + 1) % EVT_QUEUE_SIZE;
+    if(next == EVT_tail[level]) {
+        EVT_dropped[level]++;
+        return 0;
+    }
+
+    // fill in the entry before publishing it
+    EVT_queue[level][head] = (type << 16) | (arg & 0xFFFF);
+    EVT_head[level] = next;
+    SCH_signal(SCH_TASK_EVENTS);
+    return 1;
+}
+
+int EVT_process(void) {
+    /**
+     * Run all posted events
+     *
+     * Called from the main loop. Queues are drained from the highest 
+     * priority level down; events keep their order within a level.
+     *
+     * Returns the number of events run.
+     */
+    int level;
+    int count = 0;
+    unsigned char tail;
+    unsigned int event;
+
+    for(level = EVT_LEVELS - 1; level >= 0; level--) {
+        tail = EVT_tail[level];
+        while(tail != EVT_head[level]) {
+            event = EVT_queue[level][tail];
+            tail = (tail + 1) % EVT_QUEUE_SIZE;
+            EVT_tail[level] = tail;
+            EVT_handle(event >> 16, (short)(event & 0xFFFF));
+            count++;
+        }
+    }
+    return count;
+}
+
+unsigned int EVT_getDropped(void) {
+    /**
+     * Get the number of events dropped because a queue was full
+     */
+    unsigned int dropped = 0;
+    int level;
+
+    for(level = 0; level < EVT_LEVELS; level++) {
+        dropped += EVT_dropped[level];
+    }
+    return dropped;
+}
+
+static void EVT_handle(int type, int arg) {
+    /**
+     * Run one event
+     */
+    switch(type) {
+        case EVT_MDAC_STEP:
+            if(arg > 0) {
+                MDAC_increment(arg);
+            } else {
+                MDAC_decrement(-arg);
+            }
+            break;
+        case EVT_MDAC_RESET:
+            MDAC_resetValue();
+            break;
+        case EVT_TONE_SONG:
+            TONE_playSong(arg);
+            break;
+        case EVT_DBG_COMMAND:
+            DBG_processCommand();
+            break;
+        default:
+            break;
+    }
+}
@@ -0,0 +1,26 @@
+/**
+ * \file event.h
+ * \brief Header file for event.c
+ */
+
+#ifndef EVENT_H
+#define EVENT_H
+
+#include <plib.h>
+#include "globals.h"
+
+/* Event types */
+#define EVT_MDAC_STEP 1         // arg = signed MDAC step
+#define EVT_MDAC_RESET 2
+#define EVT_TONE_SONG 3         // arg = song number
+#define EVT_DBG_COMMAND 4       // a debug UART command line is waiting
+
+#define EVT_LEVELS 8
+#define EVT_QUEUE_SIZE 16
+
+void EVT_init(void);
+int EVT_post(int type, int arg);
+int EVT_process(void);
+unsigned int EVT_getDropped(void);
+
+#endif
@@ -6,7 +6,7 @@
 #ifndef GLOBALS_H
 #define GLOBALS_H
 
-#define VERSION 2002
+#define VERSION 2003
 
 #include <GenericTypeDefs.h>
 #include <peripheral/int.h>
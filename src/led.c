@@ -4,28 +4,49 @@
  */
 
 #include "led.h"
+#include "swtimer.h"
+
+// Length of each step of the LED test, in ms
+#define LED_TEST_STEP 50
+
+static struct SWT_timer LED_test_timer;
+static int LED_test_step;
+static int LED_test_saved;
+
+static void LED_testStep(void* arg);
 
 void LED_init() {
     /**
      * Initialize the LEDs
      */
     mLED_Init();
+    SWT_setup(&LED_test_timer, LED_testStep, NULL);
 }
 
 void LED_test() {
     /**
      * Test the LEDs
+     *
+     * Flashes LED 1 on, then off, then puts it back as it was. A software
+     * timer steps through the flash, so this returns straight away.
      */
-    // just flash the LEDs a few times
+    if(!SWT_isActive(&LED_test_timer)) {
+        LED_test_saved = mLED_1;
+    }
+    LED_test_step = 0;
+    mLED_1_On();
+    SWT_start(&LED_test_timer, LED_TEST_STEP, LED_TEST_STEP);
+}
 
-    int i,j;
-    int delay = 100000;
-    char old_lat = LED_LAT;
-   
-    LED_LAT = LED_LAT | 0x01;
-    for(i = 0; i < delay; i++);
-    LED_LAT = LED_LAT & ~0x01;
-    for(i = 0; i < delay; i++);
-    
-    LED_LAT = old_lat;
+static void LED_testStep(void* arg) {
+    /**
+     * Move the LED test on a step
+     */
+    if(LED_test_step == 0) {
+        mLED_1_Off();
+        LED_test_step = 1;
+    } else {
+        mLED_1 = LED_test_saved;
+        SWT_stop(&LED_test_timer);
+    }
 }
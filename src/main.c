@@ -13,6 +13,16 @@
 #include "encoder.h"
 #include "chaos.h"
 #include "tone.h"
+#include "telemetry.h"
+#include "event.h"
+#include "uart_stream.h"
+#include "command.h"
+#include "profile.h"
+#include "trace.h"
+#include "mem.h"
+#include "sched.h"
+#include "swtimer.h"
+#include "clock.h"
 /**********************
  * Configuration Bits *
  **********************/
@@ -41,6 +51,73 @@
             
 #endif // OVERRIDE_CONFIG_BITS
 
+static int usbTask(void) {
+    /**
+     * Handle USB bus events, then answer a pending data request, keep the
+     * throughput test or an upload going, or run the next command from 
+     * the PC
+     *
+     * Signalled by the USB interrupt and every timer2 tick. Runs again 
+     * while it makes progress, since the command ring can hold two 
+     * commands; a test or upload waiting on the bus waits for the next 
+     * signal instead.
+     */
+    int busy;
+    int again = 0;
+
+    busy = USB_handleEvents();
+    if(SMP_DATA_REQUESTED) {
+        // the reply waits for its block; the ADC ISR signals when it fills
+        SMP_serviceRequest();
+        again = !SMP_DATA_REQUESTED;
+    } else if(USB_bulkTestRunning()) {
+        again = USB_serviceBulkTest();
+    } else if(USB_uploadRunning()) {
+        again = USB_serviceUpload();
+    } else if(USB_getNextCommand()) {
+        CMD_runUSB(&USB_command);
+        again = 1;
+    }
+
+    // the timer2 tick signals this every ms; only count it if it did work
+    if(busy || again) {
+        TLM_loopBusy();
+    }
+    return again;
+}
+
+static int eventTask(void) {
+    /**
+     * Run work posted by the encoder and UART interrupts
+     */
+    if(EVT_process()) {
+        TLM_loopBusy();
+    }
+    return 0;
+}
+
+static int timersTask(void) {
+    /**
+     * Run the software timers that are due
+     */
+    if(SWT_service()) {
+        TLM_loopBusy();
+    }
+    return 0;
+}
+
+static int streamTask(void) {
+    /**
+     * Feed the UART sample stream
+     *
+     * Signalled when a block fills and when a frame has gone out.
+     */
+    if(UST_service()) {
+        TLM_loopBusy();
+    }
+    return 0;
+}
+
 void init(void) {
     /**
      * Initialize the system
@@ -50,16 +127,37 @@ void init(void) {
      */
     SYSTEMConfig(SYS_CLOCK, SYS_CFG_WAIT_STATES | SYS_CFG_PCACHE);
 
+    TLM_init();
+    TRC_init();
+    SCH_init();
+    SCH_setTask(SCH_TASK_USB, usbTask);
+    SCH_setTask(SCH_TASK_EVENTS, eventTask);
+    SCH_setTask(SCH_TASK_TIMERS, timersTask);
+    SCH_setTask(SCH_TASK_STREAM, streamTask);
+    SWT_init();
+    EVT_init();
+    CMD_init();
+    SMP_init();
+
+    // USB comes up first so the host can start enumerating as soon as 
+    // the scheduler runs; timer2 keeps its attach and resume timers going
     USB_init();
+    TMR2_init();
+
+    // none of these wait on the hardware; slow output (the debug UART 
+    // help) is queued and goes out from the tasks
     LED_init();
     ADC_init();
     ENC_init();
     DBG_init();
     MDAC_init();
     TONE_init();
-    TMR2_init();
+    PROF_init();
     CHAOS_init();
-    
+
+    // start out in demonstration mode: demo LED on, encoder enabled and
+    // the sample buffers ready for the first block
+    SMP_gotoDemonstrationMode();
 }
 
 int main ( void ) {
@@ -67,21 +165,26 @@ int main ( void ) {
      * Main routine
      *
      * The main program execution happens here. Everything gets
-     * initialized, and then the main loop simply checks for commands 
-     * from the PC and processes them. 
+     * initialized, and then the scheduler (see sched.c) runs the tasks
+     * below whenever an interrupt signals them: USB, the events posted 
+     * by the encoder and UART ISRs (see event.c), the software timers 
+     * (see swtimer.c) and the UART stream.
      * 
      * Checks for the watchdog timer reset and outputs a warning message
      * to the debugger.
      *
-     * The user interface is entirely interrupt driven (see encoder.c), 
-     * so the main loop is very clean and concise.
-     *
      * The ADC is also working hard in the background to fill buffers
      * which can then be sent out over USB. This is handled in adc.c.
      *
-     * Finally, we reset 2 second the watchdog timer here because if the
-     * main loop is running, nothing is hanging.
+     * Finally, the scheduler feeds the 2 second watchdog timer as long 
+     * as no task is hanging or starved.
      */
+    // start the clock the boot times are measured from
+    CLK_init();
+
+    // paint the stack before anything runs on it
+    MEM_paintStack();
+
     // initialize everything
     init();
 
@@ -96,54 +199,11 @@ int main ( void ) {
 
     EnableWDT(); // enable the WDT
 
-    // Main Processing Loop
-    while(1)
-    {
-        // Check USB for events and handle them appropriately.
-        USB_handleEvents();
-        // Check for a new command for the PC
-        if(USB_getNextCommand()) {
-            // run the specified command if we got one
-            switch(USB_command.command) {
-                case CMD_ping:
-                    USB_sendPingReply();
-                    break;
-                case CMD_status:
-                    USB_sendStatus();
-                    break;
-                case CMD_LED_test:
-                    LED_test();
-                    USB_sendAck();
-                    break;
-                case CMD_reset:
-                    USB_sendAck();
-                    break;
-                case CMD_start_sample:
-                    SMP_start(USB_command.mdac_value);
-                    USB_sendAck();
-                    break;
-                case CMD_end_sample:
-                    SMP_end();
-                    USB_sendAck();
-                    break;
-                case CMD_get_data:
-                    USB_sendRaw(SMP_getNextSendBuffer(),1024);
-                    break;
-                case CMD_set_mdac:
-                    MDAC_setValue(USB_command.mdac_value);
-                    USB_sendAck();
-                    break;
-                case CMD_get_version:
-                    USB_sendVersion();
-                    break;
-                default: 
-                    break;
-            }
-        }
-
-        ClearWDT(); // Service the WDT
-        
-    }
+    // reported in the status reply, with the time to the first SETUP
+    TLM_recordInitDone();
+
+    // Run the tasks; this doesn't return
+    SCH_run();
 
     return 0;
 }
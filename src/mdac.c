@@ -5,25 +5,35 @@
 
 #include "mdac.h"
 #include "globals.h"
+#include "telemetry.h"
+#include "trace.h"
 
 #define SPI_PORT IOPORT_G
 #define SS2 BIT_9
 #define SDO BIT_8
 #define SCLK BIT_6
 
-#define SEND_DELAY 4
-#define BIT_DELAY 1
-#define DELAY 1
-
 #define CLK_HIGH PORTWrite(SPI_PORT, SCLK)
 #define CLK_LOW PORTClearBits(SPI_PORT, SCLK)
 
 #define RESET_VALUE 4095
-#define SW_SPI
+
+// SPI2 drives the MDAC unless SW_SPI is defined, which bit-bangs the 
+// same pins instead
+#define MDAC_SPI_CHN 2
+#define MDAC_QUEUE_SIZE 8
 
 int MDAC_value;
+volatile unsigned int MDAC_drops;
 
-static void delay(long time);
+#ifndef SW_SPI
+static word MDAC_queue[MDAC_QUEUE_SIZE];
+static volatile int MDAC_queue_head;
+static volatile int MDAC_queue_tail;
+static volatile int MDAC_busy;
+
+static void MDAC_start(word data);
+#endif
 
 void MDAC_setValue(word value) {
     /**
@@ -41,7 +51,9 @@ void MDAC_setValue(word value) {
         MDAC_value = 0;
     }
     
-    // Update the MDAC
+    // Update the MDAC (waveform codes go straight to MDAC_send, so they
+    // don't flood the trace)
+    TRC_record(TRC_MDAC_WRITE, 0, MDAC_value);
     MDAC_send(0x1000 | MDAC_value);
     DBG_WriteInt(MDAC_value);
     #ifdef DEBUG
@@ -88,25 +100,24 @@ void MDAC_init(void) {
     MDAC_send(0x1000 | MDAC_value); // Set MDAC value to 0
 }
 
-void MDAC_send(word data) {
+int MDAC_send(word data) {
     /**
      * Send a command to the MDAC
      *
-     * This is done using SPI.
+     * This is done using SPI, bit-banged. Each plib port call takes 
+     * longer than the MDAC's minimum setup and clock times, so nothing
+     * needs to wait between them.
      */
     int i;
+
     // Set slave select low (select the MDAC)
     PORTClearBits(SPI_PORT, SS2);
-    delay(SEND_DELAY);
     
     // Set the clock and data lines low
     PORTClearBits(SPI_PORT, SCLK | SDO);
-    delay(BIT_DELAY);
     
     // Loop through the data to send
     for(i = 0; i < 16; i++) {
-        delay(BIT_DELAY);
-        
         // Set the clock high
         CLK_HIGH;
         
@@ -119,25 +130,23 @@ void MDAC_send(word data) {
         
         // Shift the data up
         data = data  << 1;
-        delay(BIT_DELAY);
         
         // Set clock low to advance the bit to the MDAC
         CLK_LOW;
     }
-    delay(BIT_DELAY);
     
     // Set slave select high to lock final value into MDAC
     PORTWrite(SPI_PORT, SS2);
+    return 1;
 }
 
-static void delay(long time) {
+int MDAC_isBusy(void) {
     /**
-     * Simple for loop delay routine
+     * Check if words are still being sent to the MDAC
+     *
+     * MDAC_send does not return until the word is out.
      */
-     long i;
-    long d = time * DELAY;
-     for (i=0; i<d; i++){
-     }
+    return 0;
 }
 #endif
 
@@ -147,18 +156,106 @@ void MDAC_init(void) {
     /**
     * Initializes the MDAC by setting up spi and sending command to the
     * MDAC to not forward messages.
+    *
+    * SPI2 runs in 16 bit master mode with the SPI2 receive interrupt 
+    * marking the end of each word (see MDAC_send).
     */
-    SpiChnOpen(2, SPI_CON_ON | SPI_CON_MSTEN | SPI_CON_MODE16 | SPI_CON_SMP, 64);
+    //Initialize MDAC value
+    MDAC_value = RESET_VALUE;
+    MDAC_queue_head = 0;
+    MDAC_queue_tail = 0;
+    MDAC_busy = 0;
+    MDAC_drops = 0;
+
+    // Slave select is driven by hand, idle high
+    PORTSetPinsDigitalOut(SPI_PORT, SS2);
+    PORTSetBits(SPI_PORT, SS2);
+
+    SpiChnOpen(MDAC_SPI_CHN, SPI_CON_ON | SPI_CON_MSTEN | SPI_CON_MODE16 | SPI_CON_SMP, MDAC_SPI_DIV);
+    ConfigIntSPI2(SPI_RX_INT_EN | SPI_INT_PRI_4);
+    INTEnableSystemMultiVectoredInt();
+
     MDAC_send(0x9000); // Daisy Chain disable
+    MDAC_send(0x1000 | MDAC_value); // Set MDAC to its reset value
 }
 
-void MDAC_send(word data) {
+int MDAC_send(word data) {
     /**
     * Sends a word (16 bits) of data to the MDAC
+    *
+    * This does not wait for the word to go out. If SPI2 is idle the word
+    * is started straight away, otherwise it is queued and the SPI2 
+    * interrupt starts it when the word ahead of it is done. Interrupts 
+    * are only disabled for the few instructions it takes to queue it, so
+    * this is safe (and cheap) to call from any interrupt.
+    *
+    * If the queue is full, a value write replaces a value write queued 
+    * last, since only the latest value matters to the MDAC. Anything 
+    * else is dropped, counted in MDAC_drops, and 0 is returned: control
+    * words are never merged away.
     */
+    unsigned int status;
+    int next;
+    int last;
+    int sent = 1;
+
+    status = INTDisableInterrupts();
+    if(!MDAC_busy) {
+        MDAC_busy = 1;
+        MDAC_start(data);
+    } else {
+        next = (MDAC_queue_head + 1) % MDAC_QUEUE_SIZE;
+        last = (MDAC_queue_head + MDAC_QUEUE_SIZE - 1) % MDAC_QUEUE_SIZE;
+        if(next != MDAC_queue_tail) {
+            MDAC_queue[MDAC_queue_head] = data;
+            MDAC_queue_head = next;
+        } else if((data & MDAC_CMD_MASK) == MDAC_CMD_LOAD &&
+                  (MDAC_queue[last] & MDAC_CMD_MASK) == MDAC_CMD_LOAD) {
+            MDAC_queue[last] = data;
+        } else {
+            MDAC_drops++;
+            sent = 0;
+        }
+    }
+    INTRestoreInterrupts(status);
+    return sent;
+}
+
+int MDAC_isBusy(void) {
+    /**
+     * Check if words are still being sent to the MDAC
+     */
+    return MDAC_busy;
+}
+
+static void MDAC_start(word data) {
+    /**
+     * Select the MDAC and start shifting out a word
+     */
     PORTClearBits(SPI_PORT, SS2);
-    SpiChnPutC(2, data);
-    while(!SpiChnDataRdy(2)){};
-    PORTWrite(SPI_PORT, SS2);
+    SpiChnPutC(MDAC_SPI_CHN, data);
+}
+
+void __ISR(_SPI_2_VECTOR, ipl4) SPI2Handler(void) {
+    /**
+     * SPI2 interrupt handler
+     *
+     * A word has been shifted out. Raising slave select latches it into
+     * the MDAC, then the next queued word (if any) is started.
+     */
+    unsigned int start = ReadCoreTimer();
+
+    SpiChnGetC(MDAC_SPI_CHN);
+    PORTSetBits(SPI_PORT, SS2);
+    mSPI2RXClearIntFlag();
+
+    if(MDAC_queue_tail != MDAC_queue_head) {
+        MDAC_start(MDAC_queue[MDAC_queue_tail]);
+        MDAC_queue_tail = (MDAC_queue_tail + 1) % MDAC_QUEUE_SIZE;
+    } else {
+        MDAC_busy = 0;
+    }
+
+    TLM_recordIsr(TLM_ISR_SPI2, start);
 }
 #endif
@@ -10,6 +10,16 @@
 #include "local_typedefs.h"
 
 extern int MDAC_value;
+extern volatile unsigned int MDAC_drops;
+
+/* SPI2 bit clock divider from the PB clock */
+#define MDAC_SPI_DIV 64
+/* PB clocks to shift one 16 bit word out */
+#define MDAC_WORD_PBCLKS (16 * MDAC_SPI_DIV)
+
+/* Top four bits of an MDAC word; only value writes may be merged */
+#define MDAC_CMD_MASK 0xF000
+#define MDAC_CMD_LOAD 0x1000    // load and update the DAC value
 
 enum MDAC_StepSize {
     MDAC_SMALL_STEP = 1,
@@ -18,9 +28,11 @@ enum MDAC_StepSize {
 };
 
 void MDAC_init(void);
-void MDAC_send(word data);
+int MDAC_send(word data);
+int MDAC_isBusy(void);
 void MDAC_setValue(word value);
 void MDAC_increment(enum MDAC_StepSize size);
 void MDAC_decrement(enum MDAC_StepSize size);
+void MDAC_resetValue(void);
 
 #endif
@@ -0,0 +1,88 @@
+/**
+ * \file mem.c
+ * \brief Stack high-water mark and RAM layout
+ *
+ * The linker puts initialized data, bss and the heap at the bottom of 
+ * RAM and leaves everything from _splim up to _stack (the top of RAM) 
+ * to the stack, which grows down. The ISRs all run on the same stack, 
+ * so nested interrupts show up in the high-water mark too.
+ */
+
+#include "mem.h"
+
+/* Linker symbols; only their addresses mean anything */
+extern unsigned int _heap[];
+extern unsigned int _splim[];
+extern unsigned int _stack[];
+
+static unsigned int* MEM_getStackPointer(void);
+
+void MEM_paintStack(void) {
+    /**
+     * Fill the unused stack with MEM_PAINT
+     *
+     * Must be called first thing in main, before interrupts are on. Only
+     * the stack below this function's own frame is painted.
+     */
+    unsigned int* word;
+    unsigned int* end;
+
+    end = MEM_getStackPointer();
+    for(word = _splim; word < end; word++) {
+        *word = MEM_PAINT;
+    }
+}
+
+unsigned int MEM_getRamSize(void) {
+    /**
+     * Get the size of data RAM in bytes
+     */
+    return BMXDRMSZ;
+}
+
+unsigned int MEM_getStaticSize(void) {
+    /**
+     * Get the bytes taken by initialized data and bss
+     */
+    return (unsigned int)_heap - MEM_RAM_BASE;
+}
+
+unsigned int MEM_getHeapSize(void) {
+    /**
+     * Get the bytes reserved for the heap
+     */
+    return (unsigned int)_splim - (unsigned int)_heap;
+}
+
+unsigned int MEM_getStackSize(void) {
+    /**
+     * Get the bytes left for the stack
+     */
+    return (unsigned int)_stack - (unsigned int)_splim;
+}
+
+unsigned int MEM_getStackUsed(void) {
+    /**
+     * Get the deepest the stack has been since boot, in bytes
+     *
+     * This is the distance from the top of the stack to the lowest word
+     * that no longer holds the paint. It is a lower bound: a frame that
+     * skipped over words without writing them isn't seen.
+     */
+    unsigned int* word = _splim;
+
+    while(word < _stack && *word == MEM_PAINT) {
+        word++;
+    }
+    return (unsigned int)_stack - (unsigned int)word;
+}
+
+static unsigned int* MEM_getStackPointer(void) {
+    /**
+     * Get the current stack pointer
+     */
+    unsigned int* sp;
+
+    __asm__ __volatile__("move %0, $sp" : "=r" (sp));
+    return sp;
+}
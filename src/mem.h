@@ -0,0 +1,25 @@
+/**
+ * \file mem.h
+ * \brief Header file for mem.c
+ */
+
+#ifndef MEM_H
+#define MEM_H
+
+#include <plib.h>
+#include "globals.h"
+
+/* Written over the free stack at boot */
+#define MEM_PAINT 0x5AA5C33C
+
+/* Start of data RAM (KSEG1) */
+#define MEM_RAM_BASE 0xA0000000
+
+void MEM_paintStack(void);
+unsigned int MEM_getRamSize(void);
+unsigned int MEM_getStaticSize(void);
+unsigned int MEM_getHeapSize(void);
+unsigned int MEM_getStackSize(void);
+unsigned int MEM_getStackUsed(void);
+
+#endif
@@ -0,0 +1,85 @@
+/**
+ * \file profile.c
+ * \brief Statistical profiler that samples the program counter
+ *
+ * While profiling, Timer1 interrupts at the requested rate and counts 
+ * the address it interrupted (EPC) into a histogram of program flash. 
+ * The histogram is read over USB with CMD_profile_dump and mapped back
+ * to functions with tools/profile.py.
+ *
+ * The interrupt runs at ipl7 so it lands inside the lower priority ISRs
+ * too. It can't interrupt the ADC ISR, which shares ipl7: a sample that
+ * comes due during the ADC ISR is taken right after it and counted 
+ * against the code the ADC ISR interrupted. The ISR histograms (see 
+ * telemetry.h) give the time spent in the ADC ISR itself.
+ *
+ * Pick a rate that isn't a multiple of 1 kHz, or the samples lock to 
+ * the timer2 tick.
+ */
+
+#include <string.h>
+#include "profile.h"
+
+struct PROF_data PROF_data;
+
+void PROF_init(void) {
+    /**
+     * Initialize the profiler, stopped
+     */
+    CloseTimer1();
+    memset(&PROF_data, 0, sizeof(PROF_data));
+    PROF_data.base = PROF_FLASH_BASE;
+    PROF_data.bucket_shift = PROF_BUCKET_SHIFT;
+    PROF_data.buckets = PROF_BUCKETS;
+}
+
+int PROF_start(unsigned int rate) {
+    /**
+     * Clear the histogram and start sampling rate times a second
+     *
+     * Returns 0 if the rate is out of range.
+     */
+    if(rate < PROF_MIN_RATE || rate > PROF_MAX_RATE) {
+        return 0;
+    }
+    PROF_init();
+    PROF_data.rate = rate;
+    OpenTimer1(T1_ON | T1_SOURCE_INT | T1_PS_1_64, PROF_TIMER_RATE/rate - 1);
+    ConfigIntTimer1(T1_INT_ON | T1_INT_PRIOR_7);
+    return 1;
+}
+
+void PROF_stop(void) {
+    /**
+     * Stop sampling, keeping the histogram
+     */
+    CloseTimer1();
+    PROF_data.rate = 0;
+}
+
+/* Timer 1 ISR */
+void __ISR(_TIMER_1_VECTOR, ipl7) Timer1Handler(void) {
+    /**
+     * Count the interrupted address
+     *
+     * Nothing can interrupt an ipl7 ISR, so EPC still holds the address 
+     * this interrupt returns to. Sampling stops when a bucket is full so
+     * the counts stay in proportion.
+     */
+    unsigned int offset;
+
+    // physical address, so cached and uncached code land in one bucket
+    offset = (_CP0_GET_EPC() & 0x1FFFFFFF) - PROF_FLASH_BASE;
+    mT1ClearIntFlag();
+
+    if(offset < PROF_FLASH_SIZE) {
+        if(PROF_data.counts[offset >> PROF_BUCKET_SHIFT] == 0xFFFF) {
+            PROF_stop();
+            return;
+        }
+        PROF_data.counts[offset >> PROF_BUCKET_SHIFT]++;
+    } else {
+        PROF_data.other++;
+    }
+    PROF_data.samples++;
+}
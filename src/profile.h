@@ -0,0 +1,47 @@
+/**
+ * \file profile.h
+ * \brief Header file for profile.c
+ */
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <plib.h>
+#include "globals.h"
+
+/* Program flash covered by the histogram (physical addresses) */
+#define PROF_FLASH_BASE 0x1D000000
+#define PROF_FLASH_SIZE 0x20000
+/* 256 bytes of code per bucket */
+#define PROF_BUCKET_SHIFT 8
+#define PROF_BUCKETS (PROF_FLASH_SIZE >> PROF_BUCKET_SHIFT)
+
+/* Timer1 runs at PB/64 */
+#define PROF_TIMER_RATE (SYS_CLOCK/64)
+#define PROF_MIN_RATE 10
+#define PROF_MAX_RATE 20000
+
+struct PROF_data {
+    /// Physical address of the first bucket
+    unsigned int base;
+    /// log2 of the bytes of code per bucket
+    unsigned short bucket_shift;
+    /// Number of buckets
+    unsigned short buckets;
+    /// Samples taken
+    unsigned int samples;
+    /// Samples outside program flash (boot flash, RAM)
+    unsigned int other;
+    /// Sampling rate in Hz, 0 when stopped
+    unsigned int rate;
+    /// Samples per bucket
+    unsigned short counts[PROF_BUCKETS];
+};
+
+extern struct PROF_data PROF_data;
+
+void PROF_init(void);
+int PROF_start(unsigned int rate);
+void PROF_stop(void);
+
+#endif
@@ -4,6 +4,9 @@
  */
 
 #include "sampling.h"
+#include "clock.h"
+#include "swtimer.h"
+#include "uart_stream.h"
 
 BYTE SMP_SEND_BUF[8]; 
 
@@ -14,7 +17,19 @@ int SMP_SEND_BUFFER_NUM;
 int SMP_MODE;
 int SMP_PACKET_OFFSET;
 int SMP_PACKET_ID;
-int SMP_LAST_TRANSMISSION;
+unsigned int SMP_LAST_REQUEST;
+int SMP_BLOCKS_SENT;
+int SMP_OVERRUNS;
+volatile unsigned int SMP_SAMPLE_COUNT;
+volatile int SMP_MDAC_PENDING;
+unsigned int SMP_MDAC_AT;
+int SMP_MDAC_NEXT;
+volatile int SMP_DATA_REQUESTED;
+
+// Drops back to demonstration mode when the PC stops asking for data
+static struct SWT_timer SMP_keepalive;
+
+static void SMP_keepaliveExpired(void* arg);
 
 void SMP_init(void) {
     /**
@@ -25,7 +40,8 @@ void SMP_init(void) {
      * mode.
      */
     SMP_MODE = DEMONSTRATION;
-    SMP_LAST_TRANSMISSION = 0;
+    SMP_LAST_REQUEST = CLK_ms();
+    SWT_setup(&SMP_keepalive, SMP_keepaliveExpired, NULL);
 }
 
 void SMP_start(word mdac_value) {
@@ -52,6 +68,11 @@ void SMP_start(word mdac_value) {
     SMP_SEND_BUFFER_NUM = 0;
     SMP_PACKET_ID = 0;
     SMP_PACKET_OFFSET = 4;
+    SMP_BLOCKS_SENT = 0;
+    SMP_OVERRUNS = 0;
+    SMP_SAMPLE_COUNT = 0;
+    SMP_MDAC_PENDING = 0;
+    SMP_DATA_REQUESTED = 0;
     // set first id to 0
     SMP_BUFFER[0] = 0x00;
     SMP_BUFFER[1] = 0x00;
@@ -64,46 +85,25 @@ void SMP_start(word mdac_value) {
     }    
     
     // enter sampling mode
-    SMP_LAST_TRANSMISSION = 0;
+    TRC_record(TRC_SAMPLE_START, 0, mdac_value);
+    SMP_LAST_REQUEST = CLK_ms();
+    SWT_start(&SMP_keepalive, SMP_KEEPALIVE, 0);
     SMP_MODE = SAMPLING;
     mDemonstration_LED_Off();
     ENC_intDisable();
 }
 
-void SMP_sendData(void) {
-    /**
-     * Send sampled data over USB
-     * 
-     * Waits for a buffer to be ready to send and then sends it
-     */
-    SMP_LAST_TRANSMISSION = 0;
-    // write the data buffer to the USB
-    if(!mUSBGenTxIsBusy()) {
-        // wait for the send buffer to be ready to send
-        while(!(SMP_BUFFER_STATE[SMP_SEND_BUFFER_NUM] & SMP_BUF_RTS));
-        // send it
-        USBGenWrite((BYTE*)(SMP_BUFFER+(SMP_SEND_BUFFER_NUM*1024)),1024);
-        // unset RTS for the previous buffer
-        SMP_BUFFER_STATE[(SMP_SEND_BUFFER_NUM+SMP_NUM_BUFFERS-1)%SMP_NUM_BUFFERS] &= ~SMP_BUF_RTS;
-    } else {
-        // ERROR
-    }
-
-    // move to the next buffer
-    SMP_SEND_BUFFER_NUM = (SMP_SEND_BUFFER_NUM + 1) % SMP_NUM_BUFFERS;
-}
-
 byte* SMP_getNextSendBuffer(void) {
     /**
-    * Sends a set of data over the USB buffer
-    */
+     * Take the next block to send
+     *
+     * Returns NULL if it hasn't been filled yet.
+     */
     byte* send_buffer;
-    
-    // reset the USB watchdog
-    SMP_LAST_TRANSMISSION = 0;
 
-    // wait for the send buffer to be ready to send
-    while(!(SMP_BUFFER_STATE[SMP_SEND_BUFFER_NUM] & SMP_BUF_RTS));
+    if(!(SMP_BUFFER_STATE[SMP_SEND_BUFFER_NUM] & SMP_BUF_RTS)) {
+        return NULL;
+    }
 
     // get the buffer start address
     send_buffer = SMP_BUFFER+(SMP_SEND_BUFFER_NUM*1024);
@@ -113,14 +113,125 @@ byte* SMP_getNextSendBuffer(void) {
 
     // move to the next buffer
     SMP_SEND_BUFFER_NUM = (SMP_SEND_BUFFER_NUM + 1) % SMP_NUM_BUFFERS;
+    SMP_BLOCKS_SENT++;
+    TRC_record(TRC_BLOCK_SENT, (send_buffer - SMP_BUFFER)/SMP_BUFFER_SIZE, SMP_BLOCKS_SENT);
     
     return send_buffer;
 }
 
+int SMP_requestData(void) {
+    /**
+     * Answer a request from the PC for the next block
+     *
+     * If the block isn't full yet the reply is left pending, and the USB
+     * task sends it once the ADC ISR marks the block ready (see 
+     * SMP_putWord). Until then no more commands are read. Leaving 
+     * sampling mode drops a pending request.
+     *
+     * Returns 0 if the device is not sampling.
+     */
+    if(SMP_MODE != SAMPLING) {
+        return 0;
+    }
+
+    // reset the USB watchdog
+    SMP_LAST_REQUEST = CLK_ms();
+    SWT_start(&SMP_keepalive, SMP_KEEPALIVE, 0);
+
+    SMP_DATA_REQUESTED = 1;
+    SMP_serviceRequest();
+    return 1;
+}
+
+void SMP_serviceRequest(void) {
+    /**
+     * Send the block a pending request is waiting for, if it is ready
+     */
+    byte* send_buffer;
+
+    if(!SMP_DATA_REQUESTED || mUSBGenTxIsBusy()) {
+        return;
+    }
+    send_buffer = SMP_getNextSendBuffer();
+    if(send_buffer != NULL) {
+        SMP_DATA_REQUESTED = 0;
+        USB_sendRaw(send_buffer, SMP_BUFFER_SIZE);
+    }
+}
+
+int SMP_getFillLevel(void) {
+    /**
+     * Get the number of filled blocks waiting to be sent
+     *
+     * Counted from the blocks filled and sent, since the ring positions
+     * read the same when the ADC has lapped the sender as when the ring
+     * is empty. Blocks overwritten before they were sent still count as
+     * waiting, up to the whole ring.
+     */
+    int pending;
+
+    pending = SMP_PACKET_ID - SMP_BLOCKS_SENT;
+    if(pending < 0) {
+        pending = 0;
+    }
+    if(pending > SMP_NUM_BUFFERS) {
+        pending = SMP_NUM_BUFFERS;
+    }
+    return pending;
+}
+
+int SMP_getLastTransmission(void) {
+    /**
+     * Get the ms since the PC last started sampling or asked for data
+     */
+    return CLK_ms() - SMP_LAST_REQUEST;
+}
+
+int SMP_scheduleMdac(word value, unsigned int index) {
+    /**
+     * Schedule an MDAC change at a sample index
+     *
+     * The ADC ISR writes the new value just before it stores sample 
+     * number index (counted from the start of sampling) and puts a 
+     * marker in the stream there (see SMP_MARKER_MDAC). The MDAC output
+     * follows one SPI word later.
+     *
+     * Only the low 24 bits of index are used. They are taken as the 
+     * nearest matching index, so a change that is already due is applied
+     * on the next sample. A new schedule replaces one still pending.
+     *
+     * Returns 0 if the device is not sampling.
+     */
+    unsigned int now;
+    int ahead;
+
+    if(SMP_MODE != SAMPLING) {
+        return 0;
+    }
+    if(value > 4095) {
+        value = 4095;
+    }
+
+    // sign extend the 24 bit distance to the current sample (read the 
+    // count once, so the ISR can't move it between here and SMP_MDAC_AT)
+    now = SMP_SAMPLE_COUNT;
+    ahead = (int)((index - now) << 8) >> 8;
+    if(ahead < 0) {
+        ahead = 0;
+    }
+
+    SMP_MDAC_PENDING = 0;
+    SMP_MDAC_AT = now + ahead;
+    SMP_MDAC_NEXT = value;
+    SMP_MDAC_PENDING = 1;
+    return 1;
+}
+
 void SMP_end(void) {
     /**
      * End a sample
      */
+    TRC_record(TRC_SAMPLE_END, 0, SMP_PACKET_ID);
     
     // switch back to demonstration mode
     SMP_gotoDemonstrationMode();
@@ -131,6 +242,9 @@ void SMP_gotoDemonstrationMode(void) {
      * Go to demonstration mode
      */
     int i;
+
+    SWT_stop(&SMP_keepalive);
+    SMP_DATA_REQUESTED = 0;
     for ( i = 0 ; i < SMP_NUM_BUFFERS; i++ ) {
         SMP_BUFFER_STATE[i] = 0x00;
     }
@@ -145,6 +259,24 @@ void SMP_gotoDemonstrationMode(void) {
     SMP_BUFFER[3] = 0x00;
 
     SMP_MODE = DEMONSTRATION;
+    TRC_record(TRC_MODE, DEMONSTRATION, 0);
     mDemonstration_LED_On();
     ENC_intEnable();
 }
+
+static void SMP_keepaliveExpired(void* arg) {
+    /**
+     * Stop sampling if the PC has gone quiet
+     *
+     * Runs SMP_KEEPALIVE ms after the last request, in the timers task.
+     * While the UART stream is on, sampling is kept going without USB 
+     * requests, until the stream is stopped.
+     */
+    if(UST_streaming) {
+        SWT_start(&SMP_keepalive, SMP_KEEPALIVE, 0);
+        return;
+    }
+    if(SMP_MODE == SAMPLING) {
+        SMP_gotoDemonstrationMode();
+    }
+}
@@ -10,12 +10,28 @@
 #include "mdac.h"
 #include "USB\usb.h"
 #include "globals.h"
+#include "trace.h"
+#include "sched.h"
 
 #define SMP_NUM_BUFFERS 20
 #define SMP_BUFFER_SIZE 1024
 
 #define SMP_BUF_RTS 0x01
 
+/* Sampling stops if the PC asks for no data for this many ms */
+#define SMP_KEEPALIVE 100
+
+/* Stream markers
+ *
+ * Samples always have their two low bits clear. A word with low bits 01
+ * starts a two word marker: the new MDAC value in bits 2-13, then the 
+ * index (samples since sampling started) of the sample that follows. 
+ * The MDAC write is issued as that sample is stored, so the new value 
+ * takes effect within the next few samples (one SPI word). The marker 
+ * can straddle a block boundary; the block id words are not part of it.
+ */
+#define SMP_MARKER_MDAC 0x01
+
 extern BYTE SMP_BUFFER_STATE[SMP_NUM_BUFFERS];
 extern BYTE SMP_BUFFER[SMP_BUFFER_SIZE * SMP_NUM_BUFFERS];
 extern int SMP_SAMPLE_BUFFER_NUM;
@@ -23,14 +39,61 @@ extern int SMP_SEND_BUFFER_NUM;
 extern int SMP_MODE;
 extern int SMP_PACKET_OFFSET;
 extern int SMP_PACKET_ID;
-extern int SMP_LAST_TRANSMISSION;
+extern unsigned int SMP_LAST_REQUEST;
+extern int SMP_BLOCKS_SENT;
+extern int SMP_OVERRUNS;
+extern volatile unsigned int SMP_SAMPLE_COUNT;
+extern volatile int SMP_MDAC_PENDING;
+extern unsigned int SMP_MDAC_AT;
+extern int SMP_MDAC_NEXT;
+extern volatile int SMP_DATA_REQUESTED;
 
 void SMP_init(void);
 void SMP_start(word mdac_value);
-void SMP_sendData(void);
 byte* SMP_getNextSendBuffer(void);
+int SMP_requestData(void);
+void SMP_serviceRequest(void);
+int SMP_getFillLevel(void);
+int SMP_getLastTransmission(void);
 void SMP_end(void);
 void SMP_gotoDemonstrationMode(void);
+int SMP_scheduleMdac(word value, unsigned int index);
+
+inline void
+SMP_putWord(unsigned int data) {
+    // write data to the buffer
+    *(unsigned int*)&(SMP_BUFFER[SMP_PACKET_OFFSET]) = data;
+    SMP_PACKET_OFFSET += 4;
+
+    if ( SMP_PACKET_OFFSET >= (SMP_SAMPLE_BUFFER_NUM+1)*SMP_BUFFER_SIZE) {
+        // A 1k block has been filled
+        
+        // mark it as ready to send
+        SMP_BUFFER_STATE[SMP_SAMPLE_BUFFER_NUM] |= SMP_BUF_RTS;
+        TRC_record(TRC_BLOCK_READY, SMP_SAMPLE_BUFFER_NUM, SMP_PACKET_ID);
+        SCH_signal(SCH_TASK_STREAM);
+        if ( SMP_DATA_REQUESTED ) {
+            SCH_signal(SCH_TASK_USB);
+        }
+        
+        // go on to the next block
+        SMP_SAMPLE_BUFFER_NUM = (SMP_SAMPLE_BUFFER_NUM + 1) % SMP_NUM_BUFFERS;
+
+        // the PC has fallen behind if that block was never sent
+        if ( SMP_BUFFER_STATE[SMP_SAMPLE_BUFFER_NUM] & SMP_BUF_RTS ) {
+            SMP_OVERRUNS++;
+            TRC_record(TRC_OVERRUN, SMP_SAMPLE_BUFFER_NUM, SMP_OVERRUNS);
+        }
+        SMP_PACKET_OFFSET = (SMP_SAMPLE_BUFFER_NUM * SMP_BUFFER_SIZE);
+
+        // mark this buffer with a sample packet id
+        // this number increments so that the PC knows 
+        // if it is missing packets
+        SMP_PACKET_ID++;
+        *(unsigned int*)&(SMP_BUFFER[SMP_PACKET_OFFSET]) = SMP_PACKET_ID;
+        SMP_PACKET_OFFSET += 4;
+    }
+}
 
 
 #endif
@@ -0,0 +1,169 @@
+/**
+ * \file sched.c
+ * \brief Cooperative run-to-completion task scheduler
+ *
+ * Everything outside the ISRs runs as a task. ISRs (or other tasks) mark
+ * a task ready with SCH_signal, and the main loop runs the highest 
+ * priority ready task to completion, found with one count-leading-zeros
+ * of the ready bitmap. A task that still has work returns non-zero and 
+ * runs again once every other ready task has had its turn, whatever 
+ * their priorities, so a busy task can't starve the ones below it.
+ *
+ * With nothing ready the CPU waits (Idle mode: the peripherals keep 
+ * running) until the next interrupt. The check and the WAIT happen with
+ * interrupts disabled; a pending interrupt still ends the WAIT and is 
+ * taken once they are restored, so a signal can't slip in between and 
+ * leave a task waiting for the next interrupt.
+ *
+ * The watchdog is fed from here, but only while no ready task has been 
+ * waiting longer than SCH_HEALTH_BUDGET, so a task that hangs or one 
+ * that never gets to run both end in a reset.
+ */
+
+#include "sched.h"
+#include "telemetry.h"
+
+volatile unsigned int SCH_ready;
+unsigned int SCH_ready_at[SCH_TASKS];
+
+static int (*SCH_tasks[SCH_TASKS])(void);
+static unsigned int SCH_max_latency[SCH_TASKS];
+
+static void SCH_clear(unsigned int bit);
+static int SCH_isHealthy(void);
+static void SCH_idle(void);
+
+void SCH_init(void) {
+    /**
+     * Initialize the scheduler with no tasks
+     */
+    int i;
+
+    SCH_ready = 0;
+    for(i = 0; i < SCH_TASKS; i++) {
+        SCH_tasks[i] = NULL;
+        SCH_max_latency[i] = 0;
+    }
+}
+
+void SCH_setTask(int task, int (*run)(void)) {
+    /**
+     * Set the function run for a task
+     *
+     * The function returns non-zero to be run again.
+     */
+    SCH_tasks[task] = run;
+}
+
+void SCH_run(void) {
+    /**
+     * Run tasks forever
+     */
+    unsigned int ready;
+    unsigned int latency;
+    unsigned int start;
+    unsigned int ran;
+    unsigned int again = 0;
+    int task;
+
+    while(1) {
+        TLM_loop();
+
+        if(SCH_isHealthy()) {
+            ClearWDT();
+        }
+
+        ready = SCH_ready;
+        if(ready == 0) {
+            if(again == 0) {
+                SCH_idle();
+                continue;
+            }
+            // everything else has run; give the tasks with more work
+            // another turn
+            while(again != 0) {
+                task = 31 - __builtin_clz(again);
+                again &= ~(1 << task);
+                SCH_signal(task);
+            }
+            continue;
+        }
+
+        task = 31 - __builtin_clz(ready);
+        SCH_clear(1 << task);
+
+        start = ReadCoreTimer();
+        latency = start - SCH_ready_at[task];
+        if(latency > SCH_max_latency[task]) {
+            SCH_max_latency[task] = latency;
+        }
+
+        if(SCH_tasks[task] != NULL && SCH_tasks[task]()) {
+            again |= 1 << task;
+        }
+
+        // nothing should hold the CPU for long; ISRs are included here,
+        // so a flagged task may just have been interrupted a lot
+        ran = ReadCoreTimer() - start;
+        if(ran > SCH_TASK_BUDGET) {
+            TLM_overBudget(task, ran);
+        }
+    }
+}
+
+unsigned int SCH_getMaxLatency(int task) {
+    /**
+     * Get the longest a task has waited to run, in core timer ticks
+     */
+    return SCH_max_latency[task];
+}
+
+static void SCH_clear(unsigned int bit) {
+    /**
+     * Clear ready bits, racing safely with SCH_signal
+     */
+    unsigned int ready;
+
+    __asm__ __volatile__(
+        "1: ll      %0, %1      \n"
+        "   and     %0, %0, %2  \n"
+        "   sc      %0, %1      \n"
+        "   beqz    %0, 1b      \n"
+        : "=&r" (ready), "+m" (SCH_ready)
+        : "r" (~bit)
+        : "memory");
+}
+
+static int SCH_isHealthy(void) {
+    /**
+     * Check that no ready task has waited past the budget
+     */
+    unsigned int ready = SCH_ready;
+    unsigned int now = ReadCoreTimer();
+    int task;
+
+    while(ready != 0) {
+        task = 31 - __builtin_clz(ready);
+        if(now - SCH_ready_at[task] > SCH_HEALTH_BUDGET) {
+            return 0;
+        }
+        ready &= ~(1 << task);
+    }
+    return 1;
+}
+
+static void SCH_idle(void) {
+    /**
+     * Wait for an interrupt
+     *
+     * The time spent waiting isn't counted as a main loop pass.
+     */
+    unsigned int status;
+
+    status = INTDisableInterrupts();
+    if(SCH_ready == 0) {
+        __asm__ __volatile__("wait");
+    }
+    INTRestoreInterrupts(status);
+    TLM_loopWake();
+}
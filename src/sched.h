@@ -0,0 +1,53 @@
+/**
+ * \file sched.h
+ * \brief Header file for sched.c
+ */
+
+#ifndef SCHED_H
+#define SCHED_H
+
+#include <plib.h>
+#include "globals.h"
+
+/* Tasks, highest priority first (the number is the ready bit) */
+#define SCH_TASK_USB 3          // bus events, commands, tests, uploads
+#define SCH_TASK_EVENTS 2       // work posted by the encoder and UART ISRs
+#define SCH_TASK_TIMERS 1       // expired software timers
+#define SCH_TASK_STREAM 0       // UART sample stream
+#define SCH_TASKS 4
+
+/* The watchdog isn't fed while a ready task has waited this long */
+#define SCH_HEALTH_BUDGET (GetSystemClock()/2/10)      // 100 ms
+
+/* A task that runs longer than this is flagged (see TLM_overBudget) */
+#define SCH_TASK_BUDGET (GetSystemClock()/2/1000)      // 1 ms
+
+extern volatile unsigned int SCH_ready;
+extern unsigned int SCH_ready_at[SCH_TASKS];
+
+void SCH_init(void);
+void SCH_setTask(int task, int (*run)(void));
+void SCH_run(void);
+unsigned int SCH_getMaxLatency(int task);
+
+inline void
+SCH_signal(int task) {
+    // mark a task ready; safe from any ISR (see TRC_claim for the ll/sc)
+    unsigned int old;
+    unsigned int ready;
+    unsigned int bit = 1 << task;
+
+    __asm__ __volatile__(
+        "1: ll      %0, %2      \n"
+        "   or      %1, %0, %3  \n"
+        "   sc      %1, %2      \n"
+        "   beqz    %1, 1b      \n"
+        : "=&r" (old), "=&r" (ready), "+m" (SCH_ready)
+        : "r" (bit)
+        : "memory");
+    if(!(old & bit)) {
+        SCH_ready_at[task] = ReadCoreTimer();
+    }
+}
+
+#endif
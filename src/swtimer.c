@@ -0,0 +1,171 @@
+/**
+ * \file swtimer.c
+ * \brief Software timers run off the 1 ms timer2 tick
+ *
+ * Timers hang off a hashed wheel: a timer due at tick t is kept in slot
+ * t % SWT_SLOTS, so each tick only has to look at one slot, and starting
+ * or stopping a timer is a list insert or unlink. Timers more than one 
+ * turn of the wheel away just stay in their slot until their tick comes
+ * round.
+ *
+ * The tick ISR only counts and checks if its slot is empty. The expired
+ * timers' callbacks run in the timers task (see sched.c), so they may 
+ * take their time, start and stop timers and call anything the main 
+ * loop can. SWT_start and SWT_stop are for task context only; ISRs 
+ * should post an event or signal a task instead.
+ *
+ * The timer structures belong to the caller and must outlive the timer.
+ */
+
+#include "swtimer.h"
+
+volatile unsigned int SWT_now;
+struct SWT_timer* SWT_wheel[SWT_SLOTS];
+
+// Last tick the timers task has handled
+static unsigned int SWT_done;
+// Timers in the wheel, or expired and waiting for their callback
+static unsigned int SWT_active;
+
+static void SWT_link(struct SWT_timer** list, struct SWT_timer* timer);
+static void SWT_unlink(struct SWT_timer* timer);
+
+void SWT_init(void) {
+    /**
+     * Initialize the wheel with no timers
+     */
+    int i;
+
+    for(i = 0; i < SWT_SLOTS; i++) {
+        SWT_wheel[i] = NULL;
+    }
+    SWT_now = 0;
+    SWT_done = 0;
+    SWT_active = 0;
+}
+
+void SWT_setup(struct SWT_timer* timer, void (*callback)(void* arg), void* arg) {
+    /**
+     * Set up a timer, stopped
+     */
+    timer->next = NULL;
+    timer->pprev = NULL;
+    timer->period = 0;
+    timer->callback = callback;
+    timer->arg = arg;
+}
+
+void SWT_start(struct SWT_timer* timer, unsigned int delay, unsigned int period) {
+    /**
+     * Start a timer delay ms from now, then every period ms (0 for once)
+     *
+     * A running timer is restarted.
+     *
+     * With no timers running the timers task isn't woken, so SWT_done 
+     * falls behind; it is moved up to now here rather than have the 
+     * next service walk every idle tick.
+     */
+    SWT_stop(timer);
+    if(SWT_active == 0) {
+        SWT_done = SWT_now;
+    }
+    if(delay == 0) {
+        delay = 1;
+    }
+    timer->period = period;
+    timer->expires = SWT_now + delay;
+    SWT_link(&SWT_wheel[timer->expires & (SWT_SLOTS - 1)], timer);
+    SWT_active++;
+
+    // the tick may have passed the slot while it was being linked
+    if((int)(SWT_now - timer->expires) >= 0) {
+        SCH_signal(SCH_TASK_TIMERS);
+    }
+}
+
+void SWT_stop(struct SWT_timer* timer) {
+    /**
+     * Stop a timer, if it is running
+     */
+    if(timer->pprev != NULL) {
+        SWT_unlink(timer);
+        SWT_active--;
+    }
+}
+
+int SWT_isActive(struct SWT_timer* timer) {
+    /**
+     * Check if a timer is running
+     */
+    return timer->pprev != NULL;
+}
+
+int SWT_service(void) {
+    /**
+     * Run the timers that are due
+     *
+     * The timers task. Catches up tick by tick, so a late run still 
+     * fires every timer once, in order. While any timer is running its 
+     * slot wakes the task at least once a turn of the wheel, so the 
+     * catch-up is short; idle stretches are skipped by SWT_start. Each slot's expired timers are 
+     * moved to a list of their own before any callback runs, so the 
+     * callbacks are free to start and stop timers.
+     *
+     * Returns the number of timers run.
+     */
+    struct SWT_timer* expired;
+    struct SWT_timer* timer;
+    struct SWT_timer* next;
+    int count = 0;
+
+    while((int)(SWT_now - SWT_done) > 0) {
+        SWT_done++;
+
+        expired = NULL;
+        for(timer = SWT_wheel[SWT_done & (SWT_SLOTS - 1)]; timer != NULL; timer = next) {
+            next = timer->next;
+            if(timer->expires == SWT_done) {
+                SWT_unlink(timer);
+                SWT_link(&expired, timer);
+            }
+        }
+
+        while(expired != NULL) {
+            timer = expired;
+            SWT_unlink(timer);
+            if(timer->period != 0) {
+                timer->expires += timer->period;
+                SWT_link(&SWT_wheel[timer->expires & (SWT_SLOTS - 1)], timer);
+            } else {
+                SWT_active--;
+            }
+            timer->callback(timer->arg);
+            count++;
+        }
+    }
+    return count;
+}
+
+static void SWT_link(struct SWT_timer** list, struct SWT_timer* timer) {
+    /**
+     * Put a timer at the head of a list
+     */
+    timer->next = *list;
+    if(timer->next != NULL) {
+        timer->next->pprev = &timer->next;
+    }
+    timer->pprev = list;
+    *list = timer;
+}
+
+static void SWT_unlink(struct SWT_timer* timer) {
+    /**
+     * Take a timer out of its list
+     */
+    *timer->pprev = timer->next;
+    if(timer->next != NULL) {
+        timer->next->pprev = timer->pprev;
+    }
+    timer->next = NULL;
+    timer->pprev = NULL;
+}
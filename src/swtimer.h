@@ -0,0 +1,47 @@
+/**
+ * \file swtimer.h
+ * \brief Header file for swtimer.c
+ */
+
+#ifndef SWTIMER_H
+#define SWTIMER_H
+
+#include <plib.h>
+#include "globals.h"
+#include "sched.h"
+
+/* Wheel slots, a power of 2 */
+#define SWT_SLOTS 64
+
+struct SWT_timer {
+    struct SWT_timer* next;
+    struct SWT_timer** pprev;
+    /// Tick the timer runs at
+    unsigned int expires;
+    /// Ticks between runs, 0 for a one-shot timer
+    unsigned int period;
+    void (*callback)(void* arg);
+    void* arg;
+};
+
+extern volatile unsigned int SWT_now;
+extern struct SWT_timer* SWT_wheel[SWT_SLOTS];
+
+void SWT_init(void);
+void SWT_setup(struct SWT_timer* timer, void (*callback)(void* arg), void* arg);
+void SWT_start(struct SWT_timer* timer, unsigned int delay, unsigned int period);
+void SWT_stop(struct SWT_timer* timer);
+int SWT_isActive(struct SWT_timer* timer);
+int SWT_service(void);
+
+inline void
+SWT_tick(void) {
+    // called from the 1 ms timer2 ISR; the timers themselves run in the
+    // timers task, which is only woken when this tick's slot has any
+    SWT_now++;
+    if(SWT_wheel[SWT_now & (SWT_SLOTS - 1)] != NULL) {
+        SCH_signal(SCH_TASK_TIMERS);
+    }
+}
+
+#endif
@@ -0,0 +1,131 @@
+/**
+ * \file telemetry.c
+ * \brief Counters used to report how the firmware is keeping up
+ */
+
+#include <string.h>
+#include "telemetry.h"
+#include "timer2.h"
+#include "clock.h"
+
+unsigned int TLM_loop_count;
+unsigned int TLM_loop_rate;
+unsigned int TLM_loop_start;
+unsigned int TLM_loop_longest;
+unsigned int TLM_loop_max;
+int TLM_loop_busy;
+unsigned int TLM_busy_ticks;
+unsigned int TLM_busy_load;
+unsigned int TLM_isr_load;
+unsigned int TLM_adc_isr_max;
+unsigned int TLM_adc_isr_avg16;
+unsigned int TLM_over_budget;
+unsigned int TLM_init_us;
+unsigned int TLM_setup_us;
+
+struct TLM_isr_histogram TLM_isr[TLM_ISR_COUNT];
+unsigned int TLM_isr_time[TLM_ISR_COUNT];
+unsigned int TLM_adc_last;
+unsigned int TLM_adc_period;
+int TLM_adc_primed;
+
+static int TLM_ms;
+static unsigned int TLM_last_loop_count;
+static unsigned int TLM_last_busy_ticks;
+static unsigned int TLM_last_isr_ticks;
+
+void TLM_init(void) {
+    /**
+     * Initialize the telemetry counters
+     */
+    TLM_loop_count = 0;
+    TLM_loop_rate = 0;
+    TLM_adc_isr_max = 0;
+    TLM_adc_isr_avg16 = 0;
+    TLM_over_budget = 0;
+    TLM_init_us = 0;
+    TLM_setup_us = 0;
+    TLM_ms = 0;
+    TLM_last_loop_count = 0;
+    TLM_loop_start = 0;
+    TLM_loop_longest = 0;
+    TLM_loop_max = 0;
+    TLM_loop_busy = 0;
+    TLM_busy_ticks = 0;
+    TLM_busy_load = 0;
+    TLM_isr_load = 0;
+    TLM_last_busy_ticks = 0;
+    TLM_last_isr_ticks = 0;
+    memset(TLM_isr_time, 0, sizeof(TLM_isr_time));
+    TLM_resetIsrStats();
+}
+
+void TLM_tick(void) {
+    /**
+     * Update the rate counters
+     *
+     * Called from the 1 ms timer2 interrupt. Once a second the number of
+     * main loop iterations since the last update becomes the loop rate,
+     * and the longest iteration and the share of the second spent in 
+     * main loop passes that did work and in ISRs (per mille) are updated.
+     *
+     * Main loop passes include the ISRs that interrupted them, and an 
+     * ISR's time includes any higher priority ISR that interrupted it, so
+     * both loads are upper bounds.
+     */
+    unsigned int isr_ticks;
+    int i;
+
+    TLM_ms++;
+    if(TLM_ms >= TMR2_TOGGLES_PER_SEC) {
+        TLM_ms = 0;
+        TLM_loop_rate = TLM_loop_count - TLM_last_loop_count;
+        TLM_last_loop_count = TLM_loop_count;
+
+        TLM_loop_max = TLM_loop_longest;
+        TLM_loop_longest = 0;
+
+        TLM_busy_load = (TLM_busy_ticks - TLM_last_busy_ticks) / (GetSystemClock()/2000);
+        TLM_last_busy_ticks = TLM_busy_ticks;
+
+        isr_ticks = 0;
+        for(i = 0; i < TLM_ISR_COUNT; i++) {
+            isr_ticks += TLM_isr_time[i];
+        }
+        TLM_isr_load = (isr_ticks - TLM_last_isr_ticks) / (GetSystemClock()/2000);
+        TLM_last_isr_ticks = isr_ticks;
+    }
+}
+
+void TLM_resetIsrStats(void) {
+    /**
+     * Clear the ISR histograms
+     *
+     * Interrupts are held off so no ISR counts into a half cleared table.
+     */
+    unsigned int status;
+
+    status = INTDisableInterrupts();
+    memset(TLM_isr, 0, sizeof(TLM_isr));
+    TLM_adc_period = ~0;
+    TLM_adc_primed = 0;
+    INTRestoreInterrupts(status);
+}
+
+void TLM_recordInitDone(void) {
+    /**
+     * Note how long init took, as the scheduler starts
+     */
+    TLM_init_us = CLK_usSinceBoot();
+}
+
+void TLM_recordSetup(void) {
+    /**
+     * Note when the host sent its first SETUP packet
+     *
+     * Called for every SETUP; only the first one after boot counts.
+     */
+    if(TLM_setup_us == 0) {
+        TLM_setup_us = CLK_usSinceBoot();
+    }
+}
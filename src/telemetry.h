@@ -0,0 +1,164 @@
+/**
+ * \file telemetry.h
+ * \brief Header file for telemetry.c
+ */
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <plib.h>
+#include "globals.h"
+#include "trace.h"
+
+/* ISRs with timing histograms (the CMD_isr_stats value) */
+#define TLM_ISR_ADC 0
+#define TLM_ISR_TIMER2 1
+#define TLM_ISR_CN 2
+#define TLM_ISR_SPI2 3
+#define TLM_ISR_DMA1 4
+#define TLM_ISR_UART1 5
+#define TLM_ISR_USB 6
+#define TLM_ISR_COUNT 7
+
+#define TLM_BUCKETS 16
+
+/* ISRs that run longer than this are flagged (see TLM_overBudget) */
+#define TLM_ISR_BUDGET (GetSystemClock()/2/20000)      // 50 us
+
+struct TLM_isr_histogram {
+    /// Interrupts by log2 of the core timer ticks from request to entry
+    unsigned int latency[TLM_BUCKETS];
+    /// Interrupts by log2 of the core timer ticks spent in the ISR
+    unsigned int duration[TLM_BUCKETS];
+};
+
+extern struct TLM_isr_histogram TLM_isr[TLM_ISR_COUNT];
+extern unsigned int TLM_isr_time[TLM_ISR_COUNT];
+extern unsigned int TLM_adc_last;
+extern unsigned int TLM_adc_period;
+extern int TLM_adc_primed;
+
+extern unsigned int TLM_loop_count;
+extern unsigned int TLM_loop_rate;
+extern unsigned int TLM_loop_start;
+extern unsigned int TLM_loop_longest;
+extern unsigned int TLM_loop_max;
+extern int TLM_loop_busy;
+extern unsigned int TLM_busy_ticks;
+extern unsigned int TLM_busy_load;
+extern unsigned int TLM_isr_load;
+extern unsigned int TLM_adc_isr_max;
+extern unsigned int TLM_adc_isr_avg16;
+extern unsigned int TLM_over_budget;
+extern unsigned int TLM_init_us;
+extern unsigned int TLM_setup_us;
+
+void TLM_init(void);
+void TLM_tick(void);
+void TLM_resetIsrStats(void);
+void TLM_recordInitDone(void);
+void TLM_recordSetup(void);
+
+inline void
+TLM_loop(void) {
+    // called at the top of every main loop pass: time the last pass and 
+    // count it as busy if it did any work
+    unsigned int now = ReadCoreTimer();
+    unsigned int length = now - TLM_loop_start;
+
+    TLM_loop_start = now;
+    if(TLM_loop_count++ == 0) {
+        return;
+    }
+    if(length > TLM_loop_longest) {
+        TLM_loop_longest = length;
+    }
+    if(TLM_loop_busy) {
+        TLM_busy_ticks += length;
+        TLM_loop_busy = 0;
+    }
+}
+
+inline void
+TLM_loopWake(void) {
+    // the main loop slept until an interrupt; start timing the pass anew
+    TLM_loop_start = ReadCoreTimer();
+}
+
+inline void
+TLM_loopBusy(void) {
+    // called by a task that did some work (not just a poll) this pass
+    TLM_loop_busy = 1;
+}
+
+inline void
+TLM_recordAdcIsr(unsigned int ticks) {
+    // track the worst case and a running average (scaled by 16)
+    if(ticks > TLM_adc_isr_max) {
+        TLM_adc_isr_max = ticks;
+    }
+    TLM_adc_isr_avg16 += ticks - (TLM_adc_isr_avg16 >> 4);
+}
+
+inline unsigned int
+TLM_bucket(unsigned int ticks) {
+    // bucket n counts 2^(n-1) <= ticks < 2^n, the last one everything longer
+    unsigned int bucket;
+
+    if(ticks == 0) {
+        return 0;
+    }
+    bucket = 32 - __builtin_clz(ticks);
+    return (bucket < TLM_BUCKETS) ? bucket : TLM_BUCKETS - 1;
+}
+
+inline void
+TLM_recordLatency(int isr, unsigned int ticks) {
+    TLM_isr[isr].latency[TLM_bucket(ticks)]++;
+}
+
+inline void
+TLM_overBudget(int who, unsigned int ticks) {
+    // a task or ISR held the CPU past its budget: count it and trace it
+    // with the time in us. A count lost to a nested ISR doesn't matter.
+    unsigned int us = ticks / (GetSystemClock()/2000000);
+
+    TLM_over_budget++;
+    TRC_record(TRC_OVER_BUDGET, who, (us < 0xFFFF) ? us : 0xFFFF);
+}
+
+inline void
+TLM_recordIsr(int isr, unsigned int start) {
+    // called last thing in the ISR, start is the core timer at entry
+    unsigned int ticks = ReadCoreTimer() - start;
+
+    TLM_isr[isr].duration[TLM_bucket(ticks)]++;
+    TLM_isr_time[isr] += ticks;
+    if(ticks > TLM_ISR_BUDGET) {
+        TLM_overBudget(0x80 | isr, ticks);
+    }
+}
+
+inline void
+TLM_recordAdcEntry(unsigned int start) {
+    // The ADC has no request timestamp, but it interrupts at a fixed rate,
+    // so lateness is measured against the shortest gap between entries 
+    // seen so far. Gaps of two periods or more mean the ADC was restarted.
+    // The first entry after a reset has no gap to measure.
+    unsigned int gap = start - TLM_adc_last;
+
+    TLM_adc_last = start;
+    if(!TLM_adc_primed) {
+        TLM_adc_primed = 1;
+        return;
+    }
+    if(gap < TLM_adc_period) {
+        TLM_adc_period = gap;
+    }
+    // gap < 2*TLM_adc_period, without overflowing the doubling
+    if(gap - TLM_adc_period < TLM_adc_period) {
+        TLM_recordLatency(TLM_ISR_ADC, gap - TLM_adc_period);
+    }
+}
+
+#endif
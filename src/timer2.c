@@ -4,12 +4,10 @@
  */
 
 #include "timer2.h"
-#include "encoder.h"
-#include "sampling.h"
-#include "tone.h"
-
-int note_count;
-int note_stop;
+#include "telemetry.h"
+#include "sched.h"
+#include "swtimer.h"
+#include "clock.h"
 
 void TMR2_init() {
     /**
@@ -21,47 +19,33 @@ void TMR2_init() {
     OpenTimer2(T2_ON | T2_SOURCE_INT | T2_PS_1_64, T2_TICK);
     ConfigIntTimer2(T2_INT_ON | T2_INT_PRIOR_6);
     INTEnableSystemMultiVectoredInt();
-    TMR2_ticks = 0;
-    note_count = 0;
-    note_stop = -1;
 }
 
 /* Timer 2 ISR */
 void __ISR(_TIMER_2_VECTOR, ipl6) Timer2Handler(void) {
     /**
      * Handle interrupts for timer2
-     * General purpose 1 ms timer controls a lot of the IO on the device
+     * General purpose 1 ms tick. Anything that needs a delay or a 
+     * period uses a software timer (see swtimer.c) instead of code here.
      */
+    unsigned int start = ReadCoreTimer();
+
+    // timer2 restarted from 0 at the period match that raised this
+    // interrupt, so its count is the latency (in PB/64 = 32 core ticks)
+    TLM_recordLatency(TLM_ISR_TIMER2, ReadTimer2()*PRESCALE/2);
      
     // clear the interrupt flag                         
     mT2ClearIntFlag();
     
-    TMR2_ticks++;
-    ENC_elapsed++;
-    
-    SMP_LAST_TRANSMISSION++;
-    
-    if(SMP_LAST_TRANSMISSION > 100) {
-        SMP_gotoDemonstrationMode();
-    }
-    
-    if(TONE_play == TRUE) {
-        if(note_stop == -1) {
-            note_stop = TMR2_ticks + TONE_beats[note_count]*TEMPO_MULTIPLER;
-        }
-        
-        if(TMR2_ticks == note_stop) {
-            note_stop = TMR2_ticks + TONE_beats[note_count]*TEMPO_MULTIPLER;
-            TONE_playNote(TONE_notes[note_count]);
-            note_count++;
-            if(note_count >= TONE_count) {
-                TONE_play = FALSE;
-                note_count = 0;
-                note_stop = -1;
-                TONE_playNote(' ');
-                DisableIntT1;
-            }
-        }
-    }
+    CLK_tick();
+    TLM_tick();
+
+    // the timers themselves run in the timers task (see swtimer.c)
+    SWT_tick();
+
+    // the USB stack's attach and resume timers count these ticks
+    SCH_signal(SCH_TASK_USB);
+
+    TLM_recordIsr(TLM_ISR_TIMER2, start);
 }
 
@@ -13,6 +13,5 @@
 #define TMR2_TOGGLES_PER_SEC 1000
 
 void TMR2_init(void);
-int TMR2_ticks;
 
 #endif
@@ -4,7 +4,8 @@
  */
  
 #include "tone.h"
-unsigned long TMR1_ticks;
+#include "swtimer.h"
+
 int TONE_tone;
 char song0notes[] = "E E E C E G g ";
 int song0beats[] = {100, 75, 
@@ -39,17 +40,20 @@ char *TONE_notes;
 int *TONE_beats;
 int TONE_play;
 
+// Ends the current note of a song
+static struct SWT_timer TONE_note_timer;
+static int TONE_note;
+
+static void TONE_nextNote(void* arg);
+
 void TONE_init() {
     /**
      * Initialize the tone library and the timer for the buzzer
      */
-    #define PB_DIV         1
-    #define PRESCALE       8
-    #define T1_TICK       (SYS_CLOCK/PB_DIV/PRESCALE/TMR1_TOGGLES_PER_SEC)
-    OpenTimer1(T1_ON | T1_SOURCE_INT | T1_PS_1_8, T1_TICK);
-    DisableIntT1;
-    INTEnableSystemMultiVectoredInt();
-    TMR1_ticks = 0;
+    /* Timer3 clocks OC5 (RD4, the buzzer pin) in PWM mode.  A duty cycle of
+     * zero holds the pin low, so the buzzer stays quiet until a note plays. */
+    OpenTimer3(T3_ON | T3_SOURCE_INT | T3_PS_1_8, 0xFFFF);
+    OpenOC5(OC_ON | OC_TIMER3_SRC | OC_PWM_FAULT_PIN_DISABLE, 0, 0);
     TONE_tone = 0;
     TONE_play = FALSE;
     PORTSetPinsDigitalOut(TONE_PORT, TONE_PIN);
@@ -58,12 +62,16 @@ void TONE_init() {
     TONE_notes = &song0notes[0];
     TONE_beats = &song0beats[0];
     TONE_count = 14;
+    SWT_setup(&TONE_note_timer, TONE_nextNote, NULL);
  }
  
  void TONE_playNote(char note) {
      /** 
      *  Sets the frequency required to play a note in a 2 octave range.  
      *  Lowercase notes are in the bottom octave, uppercase notes in the top.
+     *  The tone values are half periods in 10us units; the PWM output
+     *  makes a square wave with that half period, so the note keeps playing
+     *  without any interrupts until the next call.
      */
     char names[] = {'a', 'b', 'c', 'd', 'e', 'f', 'g', 'A', 'B', 'C', 'D', 'E', 'F', 'G', 'p', ' '};
     int tones[] = {227, 202, 192, 170, 152, 143, 128, 114, 101, 96, 85, 76, 72, 64, 160, 0};
@@ -71,12 +79,28 @@ void TONE_init() {
     for(i = 0; i < 16; i++) {
         if(names[i] == note) {
             TONE_tone = tones[i];
+            if(TONE_tone == 0) {
+                SetDCOC5PWM(0);
+            } else {
+                /* the new period can be shorter than the count Timer3 has
+                 * already reached, so restart it rather than let it run on
+                 * to 0xFFFF */
+                WriteTimer3(0);
+                WritePeriod3(2*TONE_tone*TONE_TICKS_PER_UNIT - 1);
+                SetDCOC5PWM(TONE_tone*TONE_TICKS_PER_UNIT);
+            }
             return;
         }
     }
  }
  
  void TONE_playSong(int song) {
+    /**
+     * Play a song, starting over if one is playing
+     *
+     * Each note plays for its beat count (times TEMPO_MULTIPLER) in ms;
+     * a software timer moves on to the next one.
+     */
     if(song == 0) {
         TONE_count = 14;
         TONE_notes = &song0notes[0];
@@ -86,26 +110,22 @@ void TONE_init() {
         TONE_notes = &song1notes[0];
         TONE_beats = &song1beats[0];
     }
-    ConfigIntTimer1(T1_INT_ON | T1_INT_PRIOR_7);
     TONE_play = TRUE;
+    TONE_note = 0;
+    TONE_playNote(TONE_notes[0]);
+    SWT_start(&TONE_note_timer, TONE_beats[0]*TEMPO_MULTIPLER, 0);
  }
- 
- 
-/* Timer 1 ISR */
-void __ISR(_TIMER_1_VECTOR, ipl7) Timer1Handler(void) {
+
+static void TONE_nextNote(void* arg) {
     /**
-     * Handle interrupts for timer1
-     * High priority interrupt, only ever has to toggle a pin
+     * Move on to the next note of the song, or end it
      */
-    mT1ClearIntFlag();
-    TMR1_ticks++;
-    
-    if(TONE_tone == 0) {
-        PORTClearBits(TONE_PORT, TONE_PIN);
+    TONE_note++;
+    if(TONE_note >= TONE_count) {
+        TONE_playNote(' ');
+        TONE_play = FALSE;
     } else {
-        if((TMR1_ticks % TONE_tone) == 0) {
-            PORTToggleBits(TONE_PORT, TONE_PIN);
-        }
+        TONE_playNote(TONE_notes[TONE_note]);
+        SWT_start(&TONE_note_timer, TONE_beats[TONE_note]*TEMPO_MULTIPLER, 0);
     }
 }
-
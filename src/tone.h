@@ -11,7 +11,8 @@
 
 #define TONE_PORT   IOPORT_D
 #define TONE_PIN    BIT_4
-#define TMR1_TOGGLES_PER_SEC 100000
+/* Timer3 ticks (40MHz / 8) per 10us unit of a note's half period */
+#define TONE_TICKS_PER_UNIT (SYS_CLOCK/8/100000)
 #define TEMPO_MULTIPLER 1
 
 extern int TONE_tone;
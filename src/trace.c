@@ -0,0 +1,37 @@
+/**
+ * \file trace.c
+ * \brief Binary event trace shared by all modules
+ *
+ * TRC_record appends a timestamped record to a ring that always holds 
+ * the last TRC_SIZE events. Each record claims its slot with one atomic
+ * increment of the head, so it can be called from the main loop and 
+ * from any ISR without disabling interrupts. The ring is read over USB 
+ * with CMD_trace_dump; stopping the trace first (CMD_trace 0) keeps it 
+ * from changing while it goes out.
+ */
+
+#include <string.h>
+#include "trace.h"
+
+struct TRC_dump TRC_ring;
+volatile int TRC_enabled;
+
+void TRC_init(void) {
+    /**
+     * Clear the trace and start recording
+     */
+    TRC_enabled = 0;
+    memset(&TRC_ring, 0, sizeof(TRC_ring));
+    TRC_ring.timer_rate = GetSystemClock()/2;
+    TRC_enabled = 1;
+}
+
+void TRC_stop(void) {
+    /**
+     * Stop recording, keeping the trace
+     *
+     * A record that an ISR was in the middle of writing is finished when
+     * the ISR returns.
+     */
+    TRC_enabled = 0;
+}
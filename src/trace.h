@@ -0,0 +1,84 @@
+/**
+ * \file trace.h
+ * \brief Header file for trace.c
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <plib.h>
+#include "globals.h"
+
+/* Trace events                      a                   b */
+#define TRC_SAMPLE_START 1      //   -                   MDAC value
+#define TRC_SAMPLE_END 2        //   -                   blocks produced
+#define TRC_MODE 3              //   new SMP_MODE        -
+#define TRC_BLOCK_READY 4       //   buffer              packet id
+#define TRC_BLOCK_SENT 5        //   buffer              blocks sent
+#define TRC_OVERRUN 6           //   buffer              overruns
+#define TRC_USB_START 7         //   transfer flags      length
+#define TRC_USB_DONE 8          //   transfer flags      length
+#define TRC_MDAC_WRITE 9        //   1 if scheduled      MDAC value
+#define TRC_OVER_BUDGET 10      //   SCH_TASK_* or       us, at most 65535
+                                //   0x80 + TLM_ISR_*
+
+/* Must be a power of 2 */
+#define TRC_SIZE 128
+
+struct TRC_record {
+    /// Core timer count
+    unsigned int time;
+    /// TRC_* event
+    unsigned char event;
+    unsigned char a;
+    unsigned short b;
+};
+
+struct TRC_dump {
+    /// Records written since the trace was started
+    unsigned int head;
+    /// Core timer ticks per second
+    unsigned int timer_rate;
+    /// Record n is at records[n % TRC_SIZE]
+    struct TRC_record records[TRC_SIZE];
+};
+
+extern struct TRC_dump TRC_ring;
+extern volatile int TRC_enabled;
+
+void TRC_init(void);
+void TRC_stop(void);
+
+inline unsigned int
+TRC_claim(void) {
+    // fetch and increment the head; an interrupt between ll and sc makes
+    // the sc fail (eret clears LLbit) and the claim is retried
+    unsigned int index;
+    unsigned int next;
+
+    __asm__ __volatile__(
+        "1: ll      %0, %2      \n"
+        "   addiu   %1, %0, 1   \n"
+        "   sc      %1, %2      \n"
+        "   beqz    %1, 1b      \n"
+        : "=&r" (index), "=&r" (next), "+m" (TRC_ring.head)
+        :
+        : "memory");
+    return index;
+}
+
+inline void
+TRC_record(int event, int a, int b) {
+    struct TRC_record* record;
+
+    if(!TRC_enabled) {
+        return;
+    }
+    record = &TRC_ring.records[TRC_claim() & (TRC_SIZE - 1)];
+    record->time = ReadCoreTimer();
+    record->event = event;
+    record->a = a;
+    record->b = b;
+}
+
+#endif
@@ -0,0 +1,158 @@
+/**
+ * \file uart_stream.c
+ * \brief Streams sample blocks out of UART1 using DMA
+ *
+ * Each frame is a struct UST_frame_header, one 1 KB block from 
+ * SMP_BUFFER as it would be sent over USB (so it starts with the packet
+ * id) and a struct UST_frame_trailer. tools/uart_stream.py decodes it.
+ *
+ * The stream only ever sends the block filled most recently, and does
+ * not take blocks away from USB. If the UART can't keep up with the ADC
+ * the PC sees gaps in the packet ids, never stale data.
+ */
+
+#include "uart_stream.h"
+#include "debug_uart.h"
+#include "telemetry.h"
+#include "sched.h"
+
+#define UST_DMA_CHN DMA_CHANNEL1
+#define UST_DMA_CELL 256
+
+int UST_streaming;
+unsigned int UST_frames_sent;
+
+static struct UST_frame_header UST_header;
+static struct UST_frame_trailer UST_trailer;
+static volatile int UST_busy;
+static BYTE* UST_block;
+static int UST_stage;
+static int UST_last_id;
+
+static void UST_startStage(void);
+
+void UST_start(void) {
+    /**
+     * Start streaming sample blocks out of UART1
+     *
+     * UART1 is switched to UST_BAUD_RATE and its transmitter is fed by 
+     * DMA channel 1, triggered by the UART1 TX interrupt flag.
+     */
+    if(UST_streaming) {
+        return;
+    }
+    DBG_setStreaming(1);
+
+    UST_header.sync = UST_SYNC;
+    UST_frames_sent = 0;
+    UST_busy = 0;
+    UST_last_id = SMP_PACKET_ID;
+
+    DmaChnOpen(UST_DMA_CHN, DMA_CHN_PRI2, DMA_OPEN_DEFAULT);
+    DmaChnSetEventControl(UST_DMA_CHN, DMA_EV_START_IRQ_EN | DMA_EV_START_IRQ(_UART1_TX_IRQ));
+    DmaChnSetEvEnableFlags(UST_DMA_CHN, DMA_EV_BLOCK_DONE);
+    DmaChnSetIntPriority(UST_DMA_CHN, INT_PRIORITY_LEVEL_3, INT_SUB_PRIORITY_LEVEL_0);
+    DmaChnIntEnable(UST_DMA_CHN);
+
+    UST_streaming = 1;
+}
+
+void UST_stop(void) {
+    /**
+     * Stop streaming and give UART1 back to the debug console
+     */
+    if(!UST_streaming) {
+        return;
+    }
+    UST_streaming = 0;
+    DmaChnIntDisable(UST_DMA_CHN);
+    DmaChnAbortTxfer(UST_DMA_CHN);
+    UST_busy = 0;
+    DBG_setStreaming(0);
+}
+
+int UST_service(void) {
+    /**
+     * Start the next frame if the last one is out
+     *
+     * Called from the main loop. Picks the block the ADC finished last,
+     * if it has not been sent yet, and sums it for the trailer.
+     *
+     * Returns 1 if a frame was started.
+     */
+    int i;
+    unsigned int sum;
+    unsigned int* words;
+
+    if(!UST_streaming || UST_busy || SMP_MODE != SAMPLING) {
+        return 0;
+    }
+    if(SMP_PACKET_ID == UST_last_id) {
+        return 0;
+    }
+
+    // the block before the one being sampled is complete (read the 
+    // block number first, so a block finished meanwhile is sent next)
+    i = (SMP_SAMPLE_BUFFER_NUM + SMP_NUM_BUFFERS - 1) % SMP_NUM_BUFFERS;
+    UST_last_id = SMP_PACKET_ID;
+    UST_block = SMP_BUFFER + i*SMP_BUFFER_SIZE;
+
+    sum = 0;
+    words = (unsigned int*)UST_block;
+    for(i = 0; i < SMP_BUFFER_SIZE/4; i++) {
+        sum += words[i];
+    }
+    UST_trailer.checksum = sum;
+
+    UST_busy = 1;
+    UST_stage = 0;
+    UST_startStage();
+    return 1;
+}
+
+static void UST_startStage(void) {
+    /**
+     * Start the DMA transfer for the current part of the frame
+     *
+     * The DMA source size is limited to 256 bytes, so the block goes 
+     * out in four parts between the header and the trailer.
+     */
+    void* source;
+    int size;
+
+    if(UST_stage == 0) {
+        source = &UST_header;
+        size = sizeof(UST_header);
+    } else if(UST_stage <= SMP_BUFFER_SIZE/UST_DMA_CELL) {
+        source = UST_block + (UST_stage - 1)*UST_DMA_CELL;
+        size = UST_DMA_CELL;
+    } else {
+        source = &UST_trailer;
+        size = sizeof(UST_trailer);
+    }
+
+    DmaChnSetTxfer(UST_DMA_CHN, source, (void*)&U1TXREG, size, 1, 1);
+    DmaChnStartTxfer(UST_DMA_CHN, DMA_WAIT_NOT, 0);
+}
+
+/* DMA channel 1 ISR */
+void __ISR(_DMA1_VECTOR, ipl3) DmaHandler1(void) {
+    /**
+     * Handle the end of each part of a frame
+     */
+    unsigned int start = ReadCoreTimer();
+
+    DmaChnClrEvFlags(UST_DMA_CHN, DMA_EV_BLOCK_DONE);
+    INTClearFlag(INT_SOURCE_DMA(UST_DMA_CHN));
+
+    UST_stage++;
+    if(UST_stage <= SMP_BUFFER_SIZE/UST_DMA_CELL + 1) {
+        UST_startStage();
+    } else {
+        UST_frames_sent++;
+        UST_busy = 0;
+        SCH_signal(SCH_TASK_STREAM);
+    }
+
+    TLM_recordIsr(TLM_ISR_DMA1, start);
+}
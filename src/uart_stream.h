@@ -0,0 +1,33 @@
+/**
+ * \file uart_stream.h
+ * \brief Header file for uart_stream.c
+ */
+
+#ifndef UART_STREAM_H
+#define UART_STREAM_H
+
+#include <plib.h>
+#include "globals.h"
+#include "sampling.h"
+
+#define UST_BAUD_RATE 2500000
+#define UST_SYNC 0xA55A5AA5
+
+struct UST_frame_header {
+    /// Always UST_SYNC
+    unsigned int sync;
+};
+
+struct UST_frame_trailer {
+    /// Sum of the 256 words of the block
+    unsigned int checksum;
+};
+
+extern int UST_streaming;
+extern unsigned int UST_frames_sent;
+
+void UST_start(void);
+void UST_stop(void);
+int UST_service(void);
+
+#endif
@@ -0,0 +1,57 @@
+/**
+ * \file wave.c
+ * \brief Plays a table of MDAC codes in step with the ADC
+ */
+
+#include "wave.h"
+#include "adc.h"
+
+volatile int WAVE_playing;
+unsigned short* WAVE_codes;
+int WAVE_count;
+int WAVE_mode;
+int WAVE_index;
+unsigned int WAVE_divider;
+unsigned int WAVE_countdown;
+
+int WAVE_start(struct WAVE_table* table, int size) {
+    /**
+     * Start playing a waveform table
+     *
+     * The table (see struct WAVE_table) is played from where it lies, 
+     * normally the USB upload buffer, so it must not be overwritten 
+     * while it plays; CMD_upload stops it first. The ADC ISR calls WAVE_step for every scan, so each
+     * code is held for exactly divider samples and the waveform stays 
+     * locked to the sample stream. The first code goes out on the next 
+     * scan.
+     *
+     * Returns 0 if the table does not fit in size bytes, is empty, or
+     * its divider is below WAVE_MIN_DIVIDER.
+     */
+    WAVE_stop();
+
+    if(table->count == 0 || table->divider < WAVE_MIN_DIVIDER) {
+        return 0;
+    }
+    if(sizeof(struct WAVE_table) + table->count * sizeof(unsigned short) > size) {
+        return 0;
+    }
+
+    WAVE_codes = table->codes;
+    WAVE_count = table->count;
+    WAVE_mode = table->mode;
+    WAVE_divider = table->divider;
+    WAVE_index = 0;
+    WAVE_countdown = 1;
+    WAVE_playing = 1;
+    return 1;
+}
+
+void WAVE_stop(void) {
+    /**
+     * Stop the waveform
+     *
+     * The MDAC keeps the last code sent.
+     */
+    WAVE_playing = 0;
+}
@@ -0,0 +1,60 @@
+/**
+ * \file wave.h
+ * \brief Header file for wave.c
+ */
+
+#ifndef WAVE_H
+#define WAVE_H
+
+#include <plib.h>
+#include "globals.h"
+#include "mdac.h"
+
+#define WAVE_ONE_SHOT 0
+#define WAVE_LOOP 1
+
+/* Fewest ADC scans a code can be held for, so that SPI2 sends each code 
+ * before the next one is due (2 at 13.2 us a scan, 25.6 us a word) */
+#define WAVE_MIN_DIVIDER \
+    ((MDAC_WORD_PBCLKS + ADC_SCAN_PBCLKS - 1) / ADC_SCAN_PBCLKS)
+
+struct WAVE_table {
+    /// Number of codes in the table
+    unsigned short count;
+    /// WAVE_ONE_SHOT or WAVE_LOOP
+    unsigned short mode;
+    /// ADC scans (samples) each code is held for
+    unsigned int divider;
+    /// 12 bit MDAC codes
+    unsigned short codes[];
+};
+
+extern volatile int WAVE_playing;
+extern unsigned short* WAVE_codes;
+extern int WAVE_count;
+extern int WAVE_mode;
+extern int WAVE_index;
+extern unsigned int WAVE_divider;
+extern unsigned int WAVE_countdown;
+
+int WAVE_start(struct WAVE_table* table, int size);
+void WAVE_stop(void);
+
+inline void
+WAVE_step(void) {
+    // hold the current code for WAVE_divider samples, then send the next
+    if(--WAVE_countdown != 0) {
+        return;
+    }
+    WAVE_countdown = WAVE_divider;
+    MDAC_value = WAVE_codes[WAVE_index] & 0x0FFF;
+    MDAC_send(0x1000 | MDAC_value);
+    if(++WAVE_index >= WAVE_count) {
+        WAVE_index = 0;
+        if(WAVE_mode == WAVE_ONE_SHOT) {
+            WAVE_playing = 0;
+        }
+    }
+}
+
+#endif
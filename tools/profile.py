@@ -0,0 +1,205 @@
+#!/usr/bin/env python
+"""
+Maps the chaos unit's program counter profile (see src/profile.c) back to
+functions in the firmware ELF.
+
+The profile is the CMD_profile_dump reply:
+
+    4 bytes     physical address of the first bucket
+    2 bytes     log2 of the bucket size in bytes
+    2 bytes     number of buckets
+    4 bytes     samples taken
+    4 bytes     samples outside the buckets (boot flash, RAM)
+    4 bytes     sampling rate in Hz, 0 once stopped
+    2 bytes     count for each bucket
+
+all little endian. Symbols come from `nm`; use --nm to point at the PIC32
+toolchain's (pic32-nm) if the host nm can't read MIPS ELF files.
+
+Usage:
+
+    profile.py firmware.elf profile.bin [--nm pic32-nm]
+    profile.py firmware.elf --usb [--rate 997] [--seconds 10] [--nm pic32-nm]
+    profile.py --selftest
+
+The first form reads a saved dump. --usb (pyusb) runs the profiler on a
+connected unit and saves the dump to profile.bin as well. A bucket that
+spans several functions is split between them by size. --selftest checks
+the mapping against a synthetic dump and symbol table.
+"""
+
+import struct
+import subprocess
+import sys
+import time
+
+HEADER = '<IHHIII'
+HEADER_SIZE = struct.calcsize(HEADER)
+
+VENDOR_ID = 0x04D8
+PRODUCT_ID = 0xFC47
+CMD_PROFILE = 0x0E
+CMD_PROFILE_DUMP = 0x0F
+
+
+def parse_dump(data):
+    """Returns (header dict, list of bucket counts)."""
+    base, shift, buckets, samples, other, rate = struct.unpack(
+        HEADER, data[:HEADER_SIZE])
+    counts = struct.unpack('<%dH' % buckets,
+                           data[HEADER_SIZE:HEADER_SIZE + 2 * buckets])
+    return dict(base=base, shift=shift, buckets=buckets, samples=samples,
+                other=other, rate=rate), list(counts)
+
+
+def read_symbols(elf, nm='nm'):
+    """Returns sorted (start, end, name) code ranges, physical addresses."""
+    output = subprocess.check_output([nm, '-n', '-S', '--defined-only', elf])
+    return parse_symbols(output.decode('ascii', 'replace'))
+
+
+def parse_symbols(text):
+    symbols = []
+    for line in text.splitlines():
+        fields = line.split()
+        if len(fields) == 4:
+            address, size, kind, name = fields
+            size = int(size, 16)
+        elif len(fields) == 3:
+            address, kind, name = fields
+            size = None
+        else:
+            continue
+        if kind not in 'Tt':
+            continue
+        symbols.append([int(address, 16) & 0x1FFFFFFF, size, name])
+
+    symbols.sort()
+    ranges = []
+    for i, (start, size, name) in enumerate(symbols):
+        if size is None:
+            # runs up to the next symbol
+            size = symbols[i + 1][0] - start if i + 1 < len(symbols) else 4
+        if size > 0:
+            ranges.append((start, start + size, name))
+    return ranges
+
+
+def attribute(header, counts, ranges):
+    """Returns {name: samples}, splitting buckets between functions."""
+    size = 1 << header['shift']
+    totals = {}
+    first = 0
+    for bucket, count in enumerate(counts):
+        if count == 0:
+            continue
+        low = header['base'] + bucket * size
+        high = low + size
+        while first < len(ranges) and ranges[first][1] <= low:
+            first += 1
+        covered = []
+        i = first
+        while i < len(ranges) and ranges[i][0] < high:
+            overlap = min(high, ranges[i][1]) - max(low, ranges[i][0])
+            if overlap > 0:
+                covered.append((ranges[i][2], overlap))
+            i += 1
+        if not covered:
+            covered = [('?%08x' % low, size)]
+        spanned = float(sum(overlap for name, overlap in covered))
+        for name, overlap in covered:
+            totals[name] = totals.get(name, 0.0) + count * overlap / spanned
+    return totals
+
+
+def report(header, totals, out=sys.stdout):
+    samples = header['samples']
+    out.write('%d samples, %d outside program flash\n' %
+              (samples, header['other']))
+    if samples == 0:
+        return
+    for name, count in sorted(totals.items(), key=lambda item: -item[1]):
+        out.write('%6.2f%% %9.1f  %s\n' % (100.0 * count / samples, count,
+                                          name))
+
+
+def command(packet_command, length=0):
+    return struct.pack('<BBBBhH', packet_command, 0, 0, 0, 0, length)
+
+
+def fetch_usb(rate, seconds):
+    import usb.core
+
+    device = usb.core.find(idVendor=VENDOR_ID, idProduct=PRODUCT_ID)
+    if device is None:
+        raise SystemExit('no chaos unit found')
+    device.set_configuration()
+    device.write(0x01, command(CMD_PROFILE, rate))
+    if bytes(device.read(0x81, 64))[:1] != b'\x01':
+        raise SystemExit('the unit refused rate %d' % rate)
+    time.sleep(seconds)
+    device.write(0x01, command(CMD_PROFILE, 0))
+    device.read(0x81, 64)
+    device.write(0x01, command(CMD_PROFILE_DUMP))
+    return bytes(device.read(0x81, 4096, 2000))
+
+
+def selftest():
+    ranges = parse_symbols('\n'.join([
+        '9d000000 00000100 T main',
+        '9d000100 00000080 T ADCHandler',
+        '9d000180 t helper',
+        '9d000200 00000200 T USB_handleEvents',
+        '9d000400 00000004 D not_code',
+    ]))
+    counts = [100, 40, 30, 0, 0]
+    dump = struct.pack(HEADER, 0x1D000000, 8, len(counts), 175, 5, 0)
+    dump += struct.pack('<%dH' % len(counts), *counts)
+    header, counts = parse_dump(dump)
+    totals = attribute(header, counts, ranges)
+    expected = {'main': 100.0, 'ADCHandler': 20.0, 'helper': 20.0,
+                'USB_handleEvents': 30.0}
+    ok = all(abs(totals.get(name, 0) - value) < 1e-6
+             for name, value in expected.items()) and \
+        len(totals) == len(expected)
+    report(header, totals)
+    print('selftest: %s' % ('PASS' if ok else 'FAIL'))
+    return 0 if ok else 1
+
+
+def main(argv):
+    args = argv[1:]
+    if args == ['--selftest']:
+        return selftest()
+
+    options = {'--nm': 'nm', '--rate': '997', '--seconds': '10'}
+    positional = []
+    use_usb = False
+    while args:
+        arg = args.pop(0)
+        if arg == '--usb':
+            use_usb = True
+        elif arg in options and args:
+            options[arg] = args.pop(0)
+        else:
+            positional.append(arg)
+    if len(positional) != (1 if use_usb else 2):
+        sys.stderr.write(__doc__)
+        return 2
+
+    if use_usb:
+        data = fetch_usb(int(options['--rate']), float(options['--seconds']))
+        with open('profile.bin', 'wb') as f:
+            f.write(data)
+    else:
+        with open(positional[1], 'rb') as f:
+            data = f.read()
+
+    header, counts = parse_dump(data)
+    ranges = read_symbols(positional[0], options['--nm'])
+    report(header, attribute(header, counts, ranges))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))
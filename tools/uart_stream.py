@@ -0,0 +1,165 @@
+#!/usr/bin/env python
+"""
+Decoder for the chaos unit's UART sample stream (see src/uart_stream.c).
+
+Each frame is:
+
+    4 bytes     sync word 0xA55A5AA5 (little endian)
+    1024 bytes  sample block, exactly as sent over USB: a 32 bit packet id
+                followed by 255 sample words
+    4 bytes     checksum: the sum of the 256 block words, modulo 2^32
+
+Usage:
+
+    uart_stream.py /dev/ttyUSB0 [--out blocks.bin]
+    uart_stream.py --loopback
+
+The first form reads frames from a serial port (pyserial) at 2.5 Mbaud, or
+from any file or pty if pyserial can't open it, and writes good blocks to
+--out. --loopback checks the decoder against synthetic frames pushed
+through a pty pair, including a corrupted frame and a dropped one.
+"""
+
+import os
+import struct
+import sys
+import threading
+
+SYNC = struct.pack('<I', 0xA55A5AA5)
+BLOCK_SIZE = 1024
+FRAME_SIZE = len(SYNC) + BLOCK_SIZE + 4
+BAUD_RATE = 2500000
+
+
+def checksum(block):
+    return sum(struct.unpack('<256I', block)) & 0xFFFFFFFF
+
+
+def make_frame(packet_id, samples):
+    """Build a frame the way the firmware does (used by --loopback)."""
+    block = struct.pack('<I255I', packet_id, *samples)
+    return SYNC + block + struct.pack('<I', checksum(block))
+
+
+class Decoder(object):
+    """Splits a byte stream into checked sample blocks."""
+
+    def __init__(self):
+        self.buffer = b''
+        self.frames = 0
+        self.bad = 0
+        self.missed = 0
+        self.last_id = None
+
+    def feed(self, data):
+        """Add bytes; returns a list of (packet_id, block) for good frames."""
+        self.buffer += data
+        blocks = []
+        while True:
+            start = self.buffer.find(SYNC)
+            if start < 0:
+                # keep a partial sync word
+                self.buffer = self.buffer[-(len(SYNC) - 1):]
+                return blocks
+            if len(self.buffer) - start < FRAME_SIZE:
+                self.buffer = self.buffer[start:]
+                return blocks
+
+            frame = self.buffer[start:start + FRAME_SIZE]
+            block = frame[len(SYNC):len(SYNC) + BLOCK_SIZE]
+            (expected,) = struct.unpack('<I', frame[-4:])
+            if checksum(block) != expected:
+                # resync just past this sync word
+                self.bad += 1
+                self.buffer = self.buffer[start + 1:]
+                continue
+
+            self.buffer = self.buffer[start + FRAME_SIZE:]
+            (packet_id,) = struct.unpack('<I', block[:4])
+            if self.last_id is not None and packet_id > self.last_id + 1:
+                self.missed += packet_id - self.last_id - 1
+            self.last_id = packet_id
+            self.frames += 1
+            blocks.append((packet_id, block))
+
+
+def open_port(path):
+    try:
+        import serial
+        return serial.Serial(path, BAUD_RATE, timeout=0.5)
+    except Exception:
+        return open(path, 'rb', buffering=0)
+
+
+def run(path, out_path):
+    port = open_port(path)
+    out = open(out_path, 'wb') if out_path else None
+    decoder = Decoder()
+    try:
+        while True:
+            data = port.read(4096)
+            if not data:
+                continue
+            for packet_id, block in decoder.feed(data):
+                if out:
+                    out.write(block)
+            sys.stderr.write('\rframes %d  bad %d  missed %d  last id %s' %
+                             (decoder.frames, decoder.bad, decoder.missed,
+                              decoder.last_id))
+    except KeyboardInterrupt:
+        sys.stderr.write('\n')
+    finally:
+        if out:
+            out.close()
+
+
+def loopback():
+    import tty
+
+    master, slave = os.openpty()
+    tty.setraw(slave)
+
+    frames = [make_frame(i, [(i * 255 + n) << 2 for n in range(255)])
+              for i in range(1, 11)]
+    # corrupt frame 4, drop frame 7, and put noise between frames
+    frames[3] = frames[3][:100] + b'\x00' + frames[3][101:]
+    del frames[6]
+    stream = b'\x13\x37'.join(frames)
+
+    def writer():
+        for i in range(0, len(stream), 100):
+            os.write(master, stream[i:i + 100])
+
+    thread = threading.Thread(target=writer)
+    thread.start()
+
+    decoder = Decoder()
+    ids = []
+    received = 0
+    while received < len(stream):
+        data = os.read(slave, 4096)
+        received += len(data)
+        ids += [packet_id for packet_id, block in decoder.feed(data)]
+    thread.join()
+    os.close(master)
+    os.close(slave)
+
+    expected = [1, 2, 3, 5, 6, 8, 9, 10]
+    ok = ids == expected and decoder.bad == 1 and decoder.missed == 2
+    print('ids %s  bad %d  missed %d: %s' %
+          (ids, decoder.bad, decoder.missed, 'PASS' if ok else 'FAIL'))
+    return 0 if ok else 1
+
+
+def main(argv):
+    if len(argv) >= 2 and argv[1] == '--loopback':
+        return loopback()
+    if len(argv) not in (2, 4) or (len(argv) == 4 and argv[2] != '--out'):
+        sys.stderr.write(__doc__)
+        return 2
+    run(argv[1], argv[3] if len(argv) == 4 else None)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))